@@ -56,6 +56,7 @@ std::string run_frontend_upload_blob(const std::string frontend_load_balancer_ad
 
             auto* blob_info = new frontend::BlobInfo;
             blob_info->set_size_bytes(raw_blob.size());
+            blob_info->set_blob_hash((BlobHasher() += raw_blob).finalize());
             request.set_allocated_info(blob_info);
 
             if (not writer->Write(request))
@@ -68,6 +69,12 @@ std::string run_frontend_upload_blob(const std::string frontend_load_balancer_ad
                 request.set_chunk_data(raw_blob);
                 if (not writer->Write(request))
                 {
+                    // The frontend stops reading right after the header, if it already has the blob.
+                    if (writer->Finish().ok() && response.deduplicated())
+                    {
+                        Logger::info("DONE - blob already stored, blob_hash: ", response.blob_hash());
+                        return response.blob_hash();
+                    }
                     Logger::error("Failed to upload blob DATA!");
                 }
                 else
@@ -77,7 +84,8 @@ std::string run_frontend_upload_blob(const std::string frontend_load_balancer_ad
 
                     if (auto status = writer->Finish(); status.ok())
                     {
-                        Logger::info("DONE - status OK, blob_hash: ", response.blob_hash());
+                        Logger::info("DONE - status OK, blob_hash: ", response.blob_hash(),
+                                     response.deduplicated() ? " (already stored)" : "");
                         return response.blob_hash();
                     }
                     else
@@ -116,6 +124,11 @@ void run_frontend_get_blob(const std::string& frontend_load_balancer_address, co
     Logger::info("Start receiving...");
     while (reader->Read(&response)) {
         Logger::info("next chunk");
+        if (response.has_chunk_checksum() && BlobHasher::checksum(response.chunk_data()) != response.chunk_checksum()) {
+            Logger::error("Chunk checksum mismatch at byte ", received_data.size());
+            client_ctx.TryCancel();
+            break;
+        }
         received_data += response.chunk_data();
     }
     Logger::info("Finished receiving...");
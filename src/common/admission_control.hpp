@@ -0,0 +1,158 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/resource_quota.h>
+#include "environment.hpp"
+#include "expected.hpp"
+#include "logging.hpp"
+
+/// Admission control of the streaming calls of a server. At most max_uploads uploads and max_downloads
+/// downloads run at once, and together they buffer at most memory_bytes of chunks (each call says how
+/// much it may buffer). A call over the limits waits for a slot up to max_queue_wait and never past its
+/// deadline, at most max_queued calls wait at once. The rest is rejected with RESOURCE_EXHAUSTED and
+/// a retry hint (trailing metadata RETRY_AFTER_KEY, in ms), so an overloaded server keeps serving the
+/// calls it admitted at full speed, instead of slowing all of them down until they time out.
+/// Example usage:
+///   const auto permit = admission.admit(AdmissionControl::Kind::Download, 2 * chunk_size, *context);
+///   if (!permit.has_value()) return permit.error();
+///   ... // the slot is held until the last copy of permit.value() is gone
+class AdmissionControl
+{
+public:
+    enum class Kind { Upload, Download };
+    constexpr static auto RETRY_AFTER_KEY = "retry-after-ms";
+
+    struct Options {
+        size_t max_uploads = 64;
+        size_t max_downloads = 256;
+        uint64_t memory_bytes = 1024 * 1024 * 1024;
+        size_t max_queued = 128;
+        std::chrono::milliseconds max_queue_wait = std::chrono::seconds(1);
+    };
+
+    class Permit
+    {
+        AdmissionControl& admission_;
+        Kind kind_;
+        uint64_t memory_bytes_;
+    public:
+        Permit(AdmissionControl& admission, const Kind kind, const uint64_t memory_bytes)
+            : admission_(admission), kind_(kind), memory_bytes_(memory_bytes) {}
+        ~Permit() { admission_.release(kind_, memory_bytes_); }
+        Permit(const Permit&) = delete;
+        Permit& operator=(const Permit&) = delete;
+    };
+
+    explicit AdmissionControl(const Options options) : options_(options) {}
+
+    static Options options_from(const AdmissionConfig& config)
+    {
+        Options options;
+        options.max_uploads = config.max_uploads;
+        options.max_downloads = config.max_downloads;
+        options.memory_bytes = config.buffer_memory_mb * 1024 * 1024;
+        options.max_queued = config.max_queued;
+        options.max_queue_wait = std::chrono::milliseconds(config.queue_ms);
+        return options;
+    }
+
+    /// Waits for a slot (blocks the calling thread) as long as the call may.
+    auto admit(const Kind kind, const uint64_t memory_bytes, grpc::ServerContextBase& context)
+        -> Expected<std::shared_ptr<Permit>, grpc::Status>
+    {
+        const auto until_deadline = context.deadline() - std::chrono::system_clock::now();
+        const auto deadline = std::chrono::steady_clock::now() +
+            std::min<std::chrono::steady_clock::duration>(options_.max_queue_wait, until_deadline);
+        std::unique_lock lock(mutex_);
+        if (!fits(kind, memory_bytes)) {
+            if (queued_ >= options_.max_queued) {
+                return reject(kind, context, "too many calls waiting");
+            }
+            queued_++;
+            const bool admitted = changed_.wait_until(lock, deadline, [&] {
+                return fits(kind, memory_bytes) || context.IsCancelled();
+            });
+            queued_--;
+            if (!admitted || context.IsCancelled()) {
+                return reject(kind, context, "no slot freed in time");
+            }
+        }
+        return take(kind, memory_bytes);
+    }
+
+    /// Doesn't wait: for the callback API, where a call must not hold a thread.
+    auto try_admit(const Kind kind, const uint64_t memory_bytes, grpc::ServerContextBase& context)
+        -> Expected<std::shared_ptr<Permit>, grpc::Status>
+    {
+        std::lock_guard lock(mutex_);
+        if (!fits(kind, memory_bytes)) {
+            return reject(kind, context, "server busy");
+        }
+        return take(kind, memory_bytes);
+    }
+
+    /// Thread limit of the gRPC server itself. A sync server runs every call on a thread of its own and
+    /// rejects the calls it has no thread for, so this bounds the calls waiting in admit() over all
+    /// connections (GRPC_ARG_MAX_CONCURRENT_STREAMS would only bound each HTTP/2 connection).
+    /// The callback server uses try_admit(), where no call waits.
+    static void configure(grpc::ServerBuilder& builder, const Options& options, const std::string& name)
+    {
+        constexpr int OTHER_CALLS = 16; // health checks, deletes
+        const int max_calls = static_cast<int>(options.max_uploads + options.max_downloads + options.max_queued)
+                              + OTHER_CALLS;
+        grpc::ResourceQuota quota(name);
+        quota.SetMaxThreads(max_calls);
+        builder.SetResourceQuota(quota);
+    }
+
+private:
+    Options options_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    size_t uploads_ = 0;
+    size_t downloads_ = 0;
+    uint64_t memory_bytes_ = 0;
+    size_t queued_ = 0;
+
+    size_t& running(const Kind kind) { return kind == Kind::Upload ? uploads_ : downloads_; }
+
+    bool fits(const Kind kind, const uint64_t memory_bytes)
+    {
+        const auto limit = kind == Kind::Upload ? options_.max_uploads : options_.max_downloads;
+        // A call bigger than the whole quota still gets in, alone.
+        const bool memory_fits = memory_bytes_ + memory_bytes <= options_.memory_bytes || memory_bytes_ == 0;
+        return running(kind) < limit && memory_fits;
+    }
+
+    std::shared_ptr<Permit> take(const Kind kind, const uint64_t memory_bytes)
+    {
+        running(kind)++;
+        memory_bytes_ += memory_bytes;
+        return std::make_shared<Permit>(*this, kind, memory_bytes);
+    }
+
+    void release(const Kind kind, const uint64_t memory_bytes)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            running(kind)--;
+            memory_bytes_ -= memory_bytes;
+        }
+        changed_.notify_all();
+    }
+
+    grpc::Status reject(const Kind kind, grpc::ServerContextBase& context, const char* reason) const
+    {
+        // By then the running calls had max_queue_wait to finish, about as long again is a fair guess.
+        const auto retry_after_ms = options_.max_queue_wait.count();
+        context.AddTrailingMetadata(RETRY_AFTER_KEY, std::to_string(retry_after_ms));
+        const auto call = kind == Kind::Upload ? "Upload" : "Download";
+        Logger::warn(call, " rejected, ", reason);
+        return grpc::Status(grpc::RESOURCE_EXHAUSTED, std::string(call) + " rejected, " + reason + ", retry after " +
+                                                      std::to_string(retry_after_ms) + " ms.");
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include "xxhash.h"
 #include <stdexcept>
 /// Incremental hashing for blob chunks.
@@ -39,6 +40,11 @@ public:
         return *this;
     }
 
+    /// XXH64 of one chunk, as in the per-chunk checksums. For a blob of one chunk, it's the blob hash.
+    static uint64_t checksum(const std::string_view bytes) {
+        return XXH64(bytes.data(), bytes.size(), 0);
+    }
+
     /// Return the hash of all data. Call ONLY ONCE per object.
     /// typedef uint64_t XXH64_hash_t;
     std::string finalize() {
@@ -0,0 +1,137 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <grpcpp/grpcpp.h>
+#include "logging.hpp"
+
+/// Process-wide, thread-safe cache of gRPC channels keyed by address.
+/// A new channel pays DNS resolution, TCP and HTTP/2 handshakes on its first call,
+/// a cached one is usually already connected.
+/// - channels not used for IDLE_TIMEOUT are dropped (unless someone still holds them),
+/// - channels in TRANSIENT_FAILURE or SHUTDOWN are recreated, which also re-resolves the address.
+/// Example usage:
+///   auto stub = ChannelPool::instance().stub<worker::WorkerService>(worker_address);
+///   stub->GetBlob(...);
+class ChannelPool {
+public:
+    constexpr static auto IDLE_TIMEOUT = std::chrono::minutes(5);
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t reconnects = 0;
+        uint64_t evictions = 0;
+        /// Time from creating a channel to seeing it READY, summed over `connected` channels.
+        /// Observed lazily (on the next use of the channel), so it's an upper bound.
+        std::chrono::microseconds setup_time{0};
+        uint64_t connected = 0;
+
+        [[nodiscard]] std::string to_string() const
+        {
+            const auto requests = hits + misses;
+            const auto hit_rate = requests ? 100.0 * hits / requests : 0.0;
+            const auto avg_setup_us = connected ? setup_time.count() / connected : 0;
+            return "hits: " + std::to_string(hits) + ", "
+                 + "misses: " + std::to_string(misses) + ", "
+                 + "hit rate: " + std::to_string(hit_rate) + "%, "
+                 + "reconnects: " + std::to_string(reconnects) + ", "
+                 + "evictions: " + std::to_string(evictions) + ", "
+                 + "avg setup time: " + std::to_string(avg_setup_us) + "us";
+        }
+    };
+
+    static ChannelPool& instance()
+    {
+        static ChannelPool pool;
+        return pool;
+    }
+
+    ChannelPool(const ChannelPool&) = delete;
+    ChannelPool& operator=(const ChannelPool&) = delete;
+
+    std::shared_ptr<grpc::Channel> get(const std::string& address)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard lock(mutex_);
+        evict_idle(now);
+
+        const auto it = channels_.find(address);
+        if (it == channels_.end()) {
+            stats_.misses++;
+            return channels_.emplace(address, Entry(address, now)).first->second.channel;
+        }
+
+        auto& entry = it->second;
+        switch (entry.channel->GetState(false)) {
+            case GRPC_CHANNEL_READY:
+                if (not entry.connected) {
+                    entry.connected = true;
+                    stats_.connected++;
+                    stats_.setup_time += std::chrono::duration_cast<std::chrono::microseconds>(now - entry.created_at);
+                }
+                break;
+            case GRPC_CHANNEL_TRANSIENT_FAILURE:
+            case GRPC_CHANNEL_SHUTDOWN:
+                Logger::warn("Channel to ", address, " is broken, reconnecting");
+                stats_.reconnects++;
+                entry = Entry(address, now);
+                break;
+            default:
+                break;
+        }
+        stats_.hits++;
+        entry.last_used = now;
+        return entry.channel;
+    }
+
+    template <typename Service>
+    std::unique_ptr<typename Service::Stub> stub(const std::string& address)
+    {
+        return Service::NewStub(get(address));
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<grpc::Channel> channel;
+        std::chrono::steady_clock::time_point created_at;
+        std::chrono::steady_clock::time_point last_used;
+        bool connected = false;
+
+        Entry(const std::string& address, const std::chrono::steady_clock::time_point now)
+            : channel(grpc::CreateChannel(address, grpc::InsecureChannelCredentials())),
+              created_at(now), last_used(now)
+        {
+            channel->GetState(true); // start connecting in the background
+        }
+    };
+
+    ChannelPool() = default;
+
+    void evict_idle(const std::chrono::steady_clock::time_point now)
+    {
+        if (now - last_sweep_ < IDLE_TIMEOUT / 2) {
+            return;
+        }
+        last_sweep_ = now;
+        std::erase_if(channels_, [&](const auto& address_entry) {
+            const auto& entry = address_entry.second;
+            const bool idle = now - entry.last_used > IDLE_TIMEOUT && entry.channel.use_count() == 1;
+            stats_.evictions += idle;
+            return idle;
+        });
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> channels_;
+    std::chrono::steady_clock::time_point last_sweep_;
+    Stats stats_;
+};
@@ -1,6 +1,17 @@
 #pragma once
+#include <chrono>
 #include <cstdint>
 
 namespace BlobStoreConfig {
 const uint64_t MAX_CHUNK_SIZE = 1024 * 1024;
-}
\ No newline at end of file
+/// Max number of chunks queued per replica in a pipelined upload,
+/// before the frontend stops reading from the client.
+const uint64_t UPLOAD_WINDOW_CHUNKS = 8;
+/// Number of workers a blob is saved on.
+const int32_t REPLICATION_FACTOR = 3;
+/// How often a worker sends its heartbeat to its master.
+const auto HEARTBEAT_INTERVAL = std::chrono::seconds(2);
+/// A worker without a heartbeat for this long is skipped by placement and reads. Longer than the
+/// worker table refresh of the other masters plus a few lost heartbeats.
+const auto HEARTBEAT_TIMEOUT = std::chrono::seconds(15);
+}
@@ -1,8 +1,10 @@
 #pragma once
+#include <functional>
 #include <optional>
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include "blob_file.hpp"
 
 // Function to retrieve an environment variable as a std::optional<std::string>
 static std::optional<std::string> get_env_var_opt(const std::string& varName) {
@@ -27,9 +29,41 @@ constexpr static auto ENV_MASTERS_COUNT = "MASTERS_COUNT";
 constexpr static auto ENV_PROJECT_ID = "PROJECT_ID";
 constexpr static auto ENV_SPANNER_INSTANCE_ID = "SPANNER_INSTANCE_ID";
 constexpr static auto ENV_DB_NAME = "DB_NAME";
+constexpr static auto ENV_PIPELINED_UPLOAD = "PIPELINED_UPLOAD";
+constexpr static auto ENV_HEDGE_DELAY_MS = "HEDGE_DELAY_MS";
+constexpr static auto ENV_READ_IDLE_TIMEOUT_MS = "READ_IDLE_TIMEOUT_MS";
+constexpr static auto ENV_FRONTEND_SERVER_MODE = "FRONTEND_SERVER_MODE";
+constexpr static auto ENV_REPLICATION_MODE = "REPLICATION_MODE";
+constexpr static auto ENV_WRITE_DURABILITY = "WRITE_DURABILITY";
+constexpr static auto ENV_STORAGE_ENGINE = "STORAGE_ENGINE";
+constexpr static auto ENV_IO_BACKEND = "IO_BACKEND";
+constexpr static auto ENV_PACKED_MAX_BLOB_KB = "PACKED_MAX_BLOB_KB";
+constexpr static auto ENV_PACKED_SEGMENT_MB = "PACKED_SEGMENT_MB";
+constexpr static auto ENV_COMPRESSION = "COMPRESSION";
+constexpr static auto ENV_COMPRESSION_LEVEL = "COMPRESSION_LEVEL";
+constexpr static auto ENV_SCRUB_MB_PER_SEC = "SCRUB_MB_PER_SEC";
+constexpr static auto ENV_SCRUB_INTERVAL_MIN = "SCRUB_INTERVAL_MIN";
+constexpr static auto ENV_SPACE_MARGIN_MB = "SPACE_MARGIN_MB";
+constexpr static auto ENV_MAX_CONCURRENT_UPLOADS = "MAX_CONCURRENT_UPLOADS";
+constexpr static auto ENV_MAX_CONCURRENT_DOWNLOADS = "MAX_CONCURRENT_DOWNLOADS";
+constexpr static auto ENV_BUFFER_MEMORY_MB = "BUFFER_MEMORY_MB";
+constexpr static auto ENV_ADMISSION_MAX_QUEUED = "ADMISSION_MAX_QUEUED";
+constexpr static auto ENV_ADMISSION_QUEUE_MS = "ADMISSION_QUEUE_MS";
+constexpr static auto ENV_BLOB_CACHE_SIZE_MB = "BLOB_CACHE_SIZE_MB";
+constexpr static auto ENV_BLOB_CACHE_MAX_BLOB_KB = "BLOB_CACHE_MAX_BLOB_KB";
 
 using ServiceAddress = std::string;
 
+static bool get_env_flag(const std::string& key) {
+    const auto value = get_env_var_opt(key);
+    return value == "1" || value == "true";
+}
+
+static uint64_t get_env_uint_or(const std::string& key, const uint64_t default_value) {
+    const auto value = get_env_var_opt(key);
+    return value ? std::stoull(*value) : default_value;
+}
+
 static int get_ordinal_from_hostname (const std::string& hostname) {
     const auto pos = hostname.find('-');
     if (pos == std::string::npos) {
@@ -38,6 +72,28 @@ static int get_ordinal_from_hostname (const std::string& hostname) {
     return std::stoi(hostname.substr(pos + 1));
 }
 
+/// Admission control of the upload and download calls of a server (worker or frontend).
+struct AdmissionConfig
+{
+    uint64_t max_uploads {};
+    uint64_t max_downloads {};
+    /// Memory the admitted calls may hold in buffered chunks.
+    uint64_t buffer_memory_mb {};
+    /// Calls waiting for a slot, the rest is rejected right away.
+    uint64_t max_queued {};
+    /// How long a call waits for a slot before it's rejected.
+    uint64_t queue_ms {};
+
+    static AdmissionConfig LoadFromEnv() {
+        AdmissionConfig config;
+        config.max_uploads = get_env_uint_or(ENV_MAX_CONCURRENT_UPLOADS, 64);
+        config.max_downloads = get_env_uint_or(ENV_MAX_CONCURRENT_DOWNLOADS, 256);
+        config.buffer_memory_mb = get_env_uint_or(ENV_BUFFER_MEMORY_MB, 1024);
+        config.max_queued = get_env_uint_or(ENV_ADMISSION_MAX_QUEUED, 128);
+        config.queue_ms = get_env_uint_or(ENV_ADMISSION_QUEUE_MS, 1000);
+        return config;
+    }
+};
 
 struct MasterConfig
 {
@@ -67,25 +123,95 @@ struct MasterConfig
 
 struct FrontendConfig
 {
+    /// Sync: a thread per call (grpc::Service), Callback: reactors and async calls (grpc::CallbackService).
+    enum class ServerMode { Sync, Callback };
+    /// FanOut: the frontend sends the blob to every worker, Chain: only to the first one,
+    /// which forwards it to the next one and so on.
+    enum class ReplicationMode { FanOut, Chain };
+
     int masters_count {};
+    /// All masters, a blob's hash picks the one responsible for it.
+    std::vector<ServiceAddress> master_services;
     uint16_t container_port {};
+    ServerMode server_mode {};
+    ReplicationMode replication_mode {};
+    /// Stream incoming chunks to all replicas right away, instead of spooling the whole blob first.
+    bool pipelined_upload {};
+    /// Memory for the hot-blob cache in GetBlob (0 disables it) and the max size of a cached blob.
+    uint64_t blob_cache_size_mb {};
+    uint64_t blob_cache_max_blob_kb {};
+    /// How long GetBlob waits for the first chunk from a replica, before asking the next one too.
+    uint64_t hedge_delay_ms {};
+    /// How long GetBlob waits for the next chunk from a replica, before it resumes on the next one.
+    uint64_t read_idle_timeout_ms {};
+    AdmissionConfig admission {};
 
     static FrontendConfig LoadFromEnv() {
         FrontendConfig config;
         config.masters_count = std::stoi(get_env_var_exn(ENV_MASTERS_COUNT));
+        for (int i = 0; i < config.masters_count; i++) {
+            config.master_services.push_back("master-" + std::to_string(i) + ".master-service:50042");
+        }
         config.container_port = std::stoi(get_env_var_exn(ENV_CONTAINER_PORT));
+        config.server_mode = [] {
+            const auto mode = get_env_var_opt(ENV_FRONTEND_SERVER_MODE).value_or("sync");
+            if (mode == "sync") return ServerMode::Sync;
+            if (mode == "callback") return ServerMode::Callback;
+            throw std::runtime_error("Invalid " + std::string(ENV_FRONTEND_SERVER_MODE) + ": " + mode);
+        }();
+        config.replication_mode = [] {
+            const auto mode = get_env_var_opt(ENV_REPLICATION_MODE).value_or("fanout");
+            if (mode == "fanout") return ReplicationMode::FanOut;
+            if (mode == "chain") return ReplicationMode::Chain;
+            throw std::runtime_error("Invalid " + std::string(ENV_REPLICATION_MODE) + ": " + mode);
+        }();
+        config.pipelined_upload = get_env_flag(ENV_PIPELINED_UPLOAD);
+        config.blob_cache_size_mb = get_env_uint_or(ENV_BLOB_CACHE_SIZE_MB, 256);
+        config.blob_cache_max_blob_kb = get_env_uint_or(ENV_BLOB_CACHE_MAX_BLOB_KB, 1024);
+        config.hedge_delay_ms = get_env_uint_or(ENV_HEDGE_DELAY_MS, 50);
+        config.read_idle_timeout_ms = get_env_uint_or(ENV_READ_IDLE_TIMEOUT_MS, 5000);
+        config.admission = AdmissionConfig::LoadFromEnv();
         return config;
     }
+
+    /// The master responsible for the blob with this hash.
+    [[nodiscard]] ServiceAddress master_address_for(const std::string& hash) const {
+        return master_services[std::hash<std::string>{}(hash) % master_services.size()];
+    }
 private:
     FrontendConfig() = default;
 };
 
 struct WorkerConfig
 {
+    /// Files: a file per blob, Packed: small blobs appended to large segment files.
+    enum class StorageEngine { Files, Packed };
+
     uint16_t container_port {};
     int masters_count {};
     ServiceAddress my_service_address;
     ServiceAddress master_service;
+    /// All masters, master_service among them.
+    std::vector<ServiceAddress> master_services;
+    /// When a saved blob must be on disk, before the worker acknowledges it.
+    BlobFile::Durability durability {};
+    StorageEngine storage_engine {};
+    /// Packed engine: blobs up to this size go to the segments, the rest to separate files.
+    uint64_t packed_max_blob_kb {};
+    uint64_t packed_segment_mb {};
+    /// Blob files are read and written through io_uring instead of blocking pread / pwrite.
+    bool io_uring {};
+    /// New blobs are stored zstd compressed, chunk by chunk (chunks that don't shrink are stored raw).
+    /// The blobs stored compressed are read either way.
+    bool compression {};
+    int compression_level {};
+    /// Read budget of the background scrubber, which re-verifies the stored blobs. 0 turns it off.
+    uint64_t scrub_mb_per_sec {};
+    /// Rest between two scrubber passes over all blobs.
+    uint64_t scrub_interval_min {};
+    /// Disk space never handed out to uploads, a cushion for the index, checksums and other writers.
+    uint64_t space_margin_mb {};
+    AdmissionConfig admission {};
 
     static WorkerConfig LoadFromEnv() {
         WorkerConfig config;
@@ -99,6 +225,35 @@ struct WorkerConfig
         const auto ordinal = get_ordinal_from_hostname(hostname);
         const int master_idx = ordinal % config.masters_count;
         config.master_service = "master-" + std::to_string(master_idx) + ".master-service:50042";
+        for (int i = 0; i < config.masters_count; i++) {
+            config.master_services.push_back("master-" + std::to_string(i) + ".master-service:50042");
+        }
+        config.durability = BlobFile::parse_durability(get_env_var_opt(ENV_WRITE_DURABILITY).value_or("none"));
+        config.storage_engine = [] {
+            const auto engine = get_env_var_opt(ENV_STORAGE_ENGINE).value_or("files");
+            if (engine == "files") return StorageEngine::Files;
+            if (engine == "packed") return StorageEngine::Packed;
+            throw std::runtime_error("Invalid " + std::string(ENV_STORAGE_ENGINE) + ": " + engine);
+        }();
+        config.packed_max_blob_kb = get_env_uint_or(ENV_PACKED_MAX_BLOB_KB, 1024);
+        config.packed_segment_mb = get_env_uint_or(ENV_PACKED_SEGMENT_MB, 256);
+        config.io_uring = [] {
+            const auto backend = get_env_var_opt(ENV_IO_BACKEND).value_or("sync");
+            if (backend == "sync") return false;
+            if (backend == "uring") return true;
+            throw std::runtime_error("Invalid " + std::string(ENV_IO_BACKEND) + ": " + backend);
+        }();
+        config.compression = [] {
+            const auto compression = get_env_var_opt(ENV_COMPRESSION).value_or("off");
+            if (compression == "off") return false;
+            if (compression == "zstd") return true;
+            throw std::runtime_error("Invalid " + std::string(ENV_COMPRESSION) + ": " + compression);
+        }();
+        config.compression_level = static_cast<int>(get_env_uint_or(ENV_COMPRESSION_LEVEL, 1));
+        config.scrub_mb_per_sec = get_env_uint_or(ENV_SCRUB_MB_PER_SEC, 32);
+        config.scrub_interval_min = get_env_uint_or(ENV_SCRUB_INTERVAL_MIN, 60);
+        config.space_margin_mb = get_env_uint_or(ENV_SPACE_MARGIN_MB, 64);
+        config.admission = AdmissionConfig::LoadFromEnv();
 
         return config;
     }
@@ -0,0 +1,32 @@
+#pragma once
+#include <mutex>
+#include <optional>
+
+/// Exponentially weighted moving average of a stream of samples (e.g. latencies), safe to share
+/// between threads. Each sample moves the average by weight * (sample - average).
+/// Example usage:
+///   Ewma latency_us(0.1);
+///   latency_us.add(elapsed_us);
+///   latency_us.value();
+class Ewma
+{
+    double weight_;
+    mutable std::mutex mutex_;
+    std::optional<double> average_;
+
+public:
+    explicit Ewma(const double weight) : weight_(weight) {}
+
+    void add(const double sample)
+    {
+        std::lock_guard lock(mutex_);
+        average_ = average_ ? *average_ + weight_ * (sample - *average_) : sample;
+    }
+
+    /// The average, if_empty before the first sample.
+    [[nodiscard]] double value(const double if_empty = 0) const
+    {
+        std::lock_guard lock(mutex_);
+        return average_.value_or(if_empty);
+    }
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/// In-memory cache of whole blobs, bounded by the total size of cached blobs.
+/// Blobs are immutable (the key is the hash of the content), so an entry only
+/// has to be invalidated when the blob gets deleted.
+///
+/// Eviction is a segmented LRU: new blobs land in the probation segment and move
+/// to the protected one (~80% of the capacity) only when they are hit again.
+/// A scan over many one-time blobs can evict only the probation segment,
+/// the blobs read repeatedly stay cached.
+/// Example usage:
+///   BlobCache cache(256 * 1024 * 1024, 1024 * 1024);
+///   const auto generation = cache.generation();
+///   ...fetch the blob...
+///   cache.put(blob_hash, blob, generation);
+///   if (auto blob = cache.get(blob_hash)) { ... }
+class BlobCache {
+    enum class Segment { Probation, Protected };
+    struct Item {
+        std::string hash;
+        std::shared_ptr<const std::string> blob;
+    };
+    using List = std::list<Item>;
+    struct Position {
+        Segment segment;
+        List::iterator it;
+    };
+
+    const uint64_t capacity_bytes_;
+    const uint64_t protected_capacity_bytes_;
+    const uint64_t max_blob_bytes_;
+
+    mutable std::mutex mutex_;
+    List probation_; // most recently used at the front
+    List protected_; // most recently used at the front
+    uint64_t probation_bytes_ = 0;
+    uint64_t protected_bytes_ = 0;
+    std::unordered_map<std::string, Position> index_;
+    uint64_t erase_count_ = 0;
+
+    void evict_to_fit()
+    {
+        // Protected overflow goes back to probation, probation overflow leaves the cache.
+        while (protected_bytes_ > protected_capacity_bytes_) {
+            auto& item = protected_.back();
+            protected_bytes_ -= item.blob->size();
+            probation_bytes_ += item.blob->size();
+            probation_.splice(probation_.begin(), protected_, std::prev(protected_.end()));
+            index_[probation_.front().hash] = {Segment::Probation, probation_.begin()};
+        }
+        while (probation_bytes_ + protected_bytes_ > capacity_bytes_ && !probation_.empty()) {
+            const auto& item = probation_.back();
+            probation_bytes_ -= item.blob->size();
+            index_.erase(item.hash);
+            probation_.pop_back();
+        }
+    }
+
+public:
+    BlobCache(const uint64_t capacity_bytes, const uint64_t max_blob_bytes)
+        : capacity_bytes_(capacity_bytes),
+          protected_capacity_bytes_(capacity_bytes / 5 * 4),
+          max_blob_bytes_(std::min(max_blob_bytes, capacity_bytes))
+    {
+    }
+
+    /// True if a blob of this size may be cached at all.
+    [[nodiscard]] bool admits(const uint64_t blob_size) const
+    {
+        return blob_size <= max_blob_bytes_;
+    }
+
+    /// Returns the cached blob or nullptr.
+    std::shared_ptr<const std::string> get(const std::string& hash)
+    {
+        std::lock_guard lock(mutex_);
+        const auto found = index_.find(hash);
+        if (found == index_.end()) {
+            return nullptr;
+        }
+
+        auto& [segment, it] = found->second;
+        auto blob = it->blob;
+        if (segment == Segment::Probation) {
+            probation_bytes_ -= blob->size();
+            protected_bytes_ += blob->size();
+            protected_.splice(protected_.begin(), probation_, it);
+            segment = Segment::Protected;
+            evict_to_fit();
+        } else {
+            protected_.splice(protected_.begin(), protected_, it);
+        }
+        return blob;
+    }
+
+    /// Changes whenever a blob is erased. Read it before fetching a blob and pass to put(),
+    /// so a blob deleted in the meantime doesn't get back into the cache.
+    [[nodiscard]] uint64_t generation() const
+    {
+        std::lock_guard lock(mutex_);
+        return erase_count_;
+    }
+
+    void put(const std::string& hash, std::string blob, const uint64_t generation)
+    {
+        if (!admits(blob.size())) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        if (generation != erase_count_ || index_.contains(hash)) {
+            return;
+        }
+        probation_bytes_ += blob.size();
+        probation_.push_front({hash, std::make_shared<const std::string>(std::move(blob))});
+        index_[hash] = {Segment::Probation, probation_.begin()};
+        evict_to_fit();
+    }
+
+    void erase(const std::string& hash)
+    {
+        std::lock_guard lock(mutex_);
+        erase_count_++;
+        const auto found = index_.find(hash);
+        if (found == index_.end()) {
+            return;
+        }
+        const auto [segment, it] = found->second;
+        if (segment == Segment::Probation) {
+            probation_bytes_ -= it->blob->size();
+            probation_.erase(it);
+        } else {
+            protected_bytes_ -= it->blob->size();
+            protected_.erase(it);
+        }
+        index_.erase(found);
+    }
+
+    [[nodiscard]] uint64_t size_bytes() const
+    {
+        std::lock_guard lock(mutex_);
+        return probation_bytes_ + protected_bytes_;
+    }
+};
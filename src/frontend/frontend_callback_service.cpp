@@ -0,0 +1,747 @@
+#include "frontend_callback_service.hpp"
+#include <mutex>
+#include <grpcpp/alarm.h>
+#include <optional>
+#include <string_view>
+#include "blob_hasher.hpp"
+#include "channel_pool.hpp"
+#include "config.hpp"
+#include "upload_helpers.hpp"
+#include <logging.hpp>
+#include <services/worker_service.grpc.pb.h>
+
+// The client reactors keep a hold (AddHold) until their owner is done with them,
+// so OnDone - which deletes them - can't run while the owner still points at them.
+
+namespace {
+
+/// Finishes a call that wasn't admitted.
+template <typename Reactor>
+class RejectedCall final : public Reactor
+{
+public:
+    explicit RejectedCall(const grpc::Status& status) { this->Finish(status); }
+    void OnDone() override { delete this; }
+};
+
+// ------------------------------------ upload ----------------------------------------------------------
+
+class BlobUpload;
+
+/// One SaveBlob stream to a worker, BlobUpload gives it one chunk at a time.
+class WorkerWrite final : public grpc::ClientWriteReactor<worker::SaveBlobRequest>
+{
+    BlobUpload& upload_;
+    grpc::ClientContext context_;
+    worker::SaveBlobRequest request_;
+    worker::SaveBlobResponse response_;
+    std::unique_ptr<worker::WorkerService::Stub> stub_;
+public:
+    const std::string address;
+
+    WorkerWrite(BlobUpload& upload, std::string worker_address, worker::SaveBlobRequest first_request)
+        : upload_(upload), request_(std::move(first_request)), address(std::move(worker_address))
+    {
+        stub_ = ChannelPool::instance().stub<worker::WorkerService>(address);
+        stub_->async()->SaveBlob(&context_, &response_, this);
+        AddHold();
+        StartCall();
+    }
+
+    void write(const std::string& chunk)
+    {
+        request_.set_chunk_data(chunk);
+        StartWrite(&request_);
+    }
+
+    /// Sends the final commit (or abort) message, after that the stream is on its own.
+    void close(const worker::SaveBlobCommit& commit)
+    {
+        request_.clear_chunk_data();
+        *request_.mutable_commit() = commit;
+        StartWriteLast(&request_, grpc::WriteOptions());
+        RemoveHold();
+    }
+
+    void cancel() { context_.TryCancel(); }
+
+    void OnWriteDone(bool ok) override;
+    void OnDone(const grpc::Status& status) override;
+};
+
+/// Receives the blob and streams it to the workers under a temporary upload id,
+/// the workers commit it under the real hash at the end.
+class BlobUpload final : public grpc::ServerReadReactor<frontend::UploadBlobRequest>
+{
+    const FrontendConfig& config_;
+    std::shared_ptr<AdmissionControl::Permit> permit_;
+    frontend::UploadBlobResponse* response_;
+    frontend::UploadBlobRequest request_;
+    bool got_info_ = false;
+    uint64_t blob_size_ = 0;
+    uint64_t received_bytes_ = 0;
+    BlobHasher blob_hasher_;
+    std::optional<std::string> claimed_hash_;
+    std::string upload_id_;
+    std::string blob_hash_;
+
+    grpc::ClientContext lookup_context_;
+    master::GetWorkerWithBlobRequest lookup_request_;
+    master::GetWorkerWithBlobResponse lookup_response_;
+    std::unique_ptr<master::MasterService::Stub> lookup_stub_;
+
+    grpc::ClientContext master_context_;
+    master::GetWorkersToSaveBlobRequest master_request_;
+    master::GetWorkersToSaveBlobResponse master_response_;
+    std::unique_ptr<master::MasterService::Stub> master_stub_;
+
+    std::mutex mutex_;
+    std::vector<WorkerWrite*> workers_;
+    size_t pending_writes_ = 0;
+    size_t running_workers_ = 0;
+    bool cancelled_ = false;
+    bool closed_ = false;
+    std::optional<grpc::Status> error_; // the first error, aborts the upload
+
+    void on_lookup(const grpc::Status& status)
+    {
+        // Blobs are content-addressed, a blob that is already stored doesn't need the data again.
+        if (status.ok() && lookup_response_.replicas_size() >= BlobStoreConfig::REPLICATION_FACTOR) {
+            Logger::info("Blob ", *claimed_hash_, " is already stored, skipping the upload.");
+            response_->set_blob_hash(*claimed_hash_);
+            response_->set_deduplicated(true);
+            Finish(grpc::Status::OK);
+            return;
+        }
+        request_workers();
+    }
+
+    void request_workers()
+    {
+        // The hash is known only at the end, so the blob is placed under a temporary upload id.
+        upload_id_ = new_upload_id();
+        master_request_.set_blob_hash(upload_id_);
+        master_request_.set_size_mb(size_in_mb(blob_size_));
+        master_stub_ = ChannelPool::instance().stub<master::MasterService>(config_.master_address_for(upload_id_));
+        master_stub_->async()->GetWorkersToSaveBlob(&master_context_, &master_request_, &master_response_,
+                                                    [this](const grpc::Status& status) { on_workers(status); });
+    }
+
+    void on_workers(const grpc::Status& status)
+    {
+        if (!status.ok()) {
+            Logger::error("Failed to get workers for upload ", upload_id_, ": ", status.error_message());
+            Finish(grpc::Status(grpc::CANCELLED, status.error_message()));
+            return;
+        }
+        const std::vector<std::string> addresses(master_response_.addresses().begin(),
+                                                 master_response_.addresses().end());
+        const auto targets = upload_targets(
+            addresses, config_.replication_mode == FrontendConfig::ReplicationMode::Chain);
+        Logger::info("Streaming upload ", upload_id_, " to workers ", targets.workers, " (chain: ", targets.chain, ")");
+        std::optional<grpc::Status> rejected;
+        {
+            std::lock_guard lock(mutex_);
+            if (cancelled_ || addresses.empty()) {
+                rejected = grpc::Status(grpc::CANCELLED, cancelled_ ? "Cancelled by client." : "No workers to save blob.");
+            } else {
+                running_workers_ = targets.workers.size();
+                for (const auto& address : targets.workers) {
+                    workers_.push_back(new WorkerWrite(*this, address,
+                                                       first_save_blob_request(upload_id_, targets.chain, blob_size_)));
+                }
+            }
+        }
+        // Not under the lock: once finished, OnDone may delete the reactor (and its mutex) right away.
+        if (rejected) {
+            Finish(*rejected);
+            return;
+        }
+        StartRead(&request_);
+    }
+
+    /// Ends the upload on all workers. Called with mutex_ held.
+    void close_workers(const worker::SaveBlobCommit& commit)
+    {
+        closed_ = true;
+        for (const auto worker : workers_) {
+            worker->close(commit);
+        }
+    }
+
+    void abort(grpc::Status status)
+    {
+        std::lock_guard lock(mutex_);
+        if (!error_) {
+            error_ = std::move(status);
+        }
+        worker::SaveBlobCommit abort;
+        abort.set_abort(true);
+        close_workers(abort);
+    }
+
+    void commit()
+    {
+        std::lock_guard lock(mutex_);
+        worker::SaveBlobCommit commit;
+        commit.set_blob_hash(blob_hash_);
+        close_workers(commit);
+    }
+
+public:
+    BlobUpload(const FrontendConfig& config, std::shared_ptr<AdmissionControl::Permit> permit,
+               frontend::UploadBlobResponse* response)
+        : config_(config), permit_(std::move(permit)), response_(response)
+    {
+        StartRead(&request_);
+    }
+
+    void OnReadDone(const bool ok) override
+    {
+        if (!got_info_) {
+            if (!ok || !request_.has_info()) {
+                Finish(grpc::Status(grpc::INVALID_ARGUMENT, "Request should start with blob info."));
+                return;
+            }
+            got_info_ = true;
+            blob_size_ = request_.info().size_bytes();
+            Logger::info("Receiving blob of size ", blob_size_);
+            if (!request_.info().has_blob_hash()) {
+                request_workers();
+                return;
+            }
+
+            claimed_hash_ = request_.info().blob_hash();
+            lookup_request_.set_blob_hash(*claimed_hash_);
+            lookup_stub_ = ChannelPool::instance().stub<master::MasterService>(config_.master_address_for(*claimed_hash_));
+            lookup_stub_->async()->GetWorkerWithBlob(&lookup_context_, &lookup_request_, &lookup_response_,
+                                                     [this](const grpc::Status& status) { on_lookup(status); });
+            return;
+        }
+
+        if (!ok) {
+            // The client has sent everything (or went away).
+            blob_hash_ = blob_hasher_.finalize();
+            if (received_bytes_ != blob_size_) {
+                abort(grpc::Status(grpc::INVALID_ARGUMENT, "Blob file size mismatch."));
+                return;
+            }
+            if (claimed_hash_ && *claimed_hash_ != blob_hash_) {
+                Logger::error("Blob hash mismatch: ", *claimed_hash_, " != ", blob_hash_);
+                abort(grpc::Status(grpc::INVALID_ARGUMENT, "Blob hash doesn't match the hash in blob info."));
+                return;
+            }
+            commit();
+            return;
+        }
+        if (!request_.has_chunk_data()) {
+            abort(grpc::Status(grpc::INVALID_ARGUMENT, "Request missing chunk data."));
+            return;
+        }
+
+        Logger::debug("Received chunk of size ", request_.chunk_data().size());
+        blob_hasher_.add_chunk(request_.chunk_data());
+        received_bytes_ += request_.chunk_data().size();
+        std::lock_guard lock(mutex_);
+        pending_writes_ = workers_.size();
+        for (const auto worker : workers_) {
+            worker->write(request_.chunk_data());
+        }
+    }
+
+    void on_worker_write_done(const WorkerWrite& worker, const bool ok)
+    {
+        std::unique_lock lock(mutex_);
+        if (closed_) {
+            return; // the final message
+        }
+        if (!ok && !error_) {
+            Logger::error("Failed to send chunk of upload ", upload_id_, " to worker ", worker.address);
+            error_ = grpc::Status(grpc::CANCELLED, "Failed to save blob to worker " + worker.address + " - broken stream");
+        }
+        if (--pending_writes_ > 0) {
+            return;
+        }
+        if (error_) {
+            lock.unlock();
+            abort(*error_);
+            return;
+        }
+        lock.unlock();
+        StartRead(&request_);
+    }
+
+    void on_worker_done(const WorkerWrite& worker, const grpc::Status& status)
+    {
+        std::unique_lock lock(mutex_);
+        if (!status.ok() && !error_) {
+            error_ = grpc::Status(grpc::CANCELLED, "Worker " + worker.address + ": " + status.error_message());
+        }
+        if (--running_workers_ > 0) {
+            return;
+        }
+        const auto error = error_;
+        lock.unlock();
+        if (error) {
+            Logger::error("Upload ", upload_id_, " failed: ", error->error_message());
+            Finish(*error);
+            return;
+        }
+        Logger::info("Blob fully received and saved to workers: ", blob_hash_);
+        response_->set_blob_hash(blob_hash_);
+        Finish(grpc::Status::OK);
+    }
+
+    void OnCancel() override
+    {
+        std::lock_guard lock(mutex_);
+        cancelled_ = true;
+        lookup_context_.TryCancel();
+        master_context_.TryCancel();
+        if (!closed_) {
+            for (const auto worker : workers_) {
+                worker->cancel();
+            }
+        }
+    }
+
+    void OnDone() override
+    {
+        delete this;
+    }
+};
+
+void WorkerWrite::OnWriteDone(const bool ok)
+{
+    clear_first_message_fields(request_);
+    upload_.on_worker_write_done(*this, ok);
+}
+
+void WorkerWrite::OnDone(const grpc::Status& status)
+{
+    upload_.on_worker_done(*this, status);
+    delete this;
+}
+
+// ------------------------------------ download --------------------------------------------------------
+
+class BlobDownload;
+
+/// One GetBlob stream from a worker, the next chunk is read only when BlobDownload asks for it.
+class WorkerRead final : public grpc::ClientReadReactor<worker::GetBlobResponse>
+{
+    BlobDownload& download_;
+    grpc::ClientContext context_;
+    worker::GetBlobRequest request_;
+    std::unique_ptr<worker::WorkerService::Stub> stub_;
+public:
+    const std::string address;
+    worker::GetBlobResponse chunk;
+
+    WorkerRead(BlobDownload& download, std::string worker_address, worker::GetBlobRequest request)
+        : download_(download), request_(std::move(request)), address(std::move(worker_address))
+    {
+        stub_ = ChannelPool::instance().stub<worker::WorkerService>(address);
+        stub_->async()->GetBlob(&context_, &request_, this);
+        AddHold();
+    }
+
+    void start()
+    {
+        StartRead(&chunk);
+        StartCall();
+    }
+
+    void read_next() { StartRead(&chunk); }
+
+    /// Cancels the stream between reads (no read in flight).
+    void cancel()
+    {
+        context_.TryCancel();
+        RemoveHold();
+    }
+
+    /// Cancels the stream at any time, the read in flight fails.
+    void try_cancel() { context_.TryCancel(); }
+
+    void OnReadDone(bool ok) override;
+    void OnDone(const grpc::Status& status) override;
+};
+
+/// Sends the blob (or its byte range) from the cache or from one of the replicas.
+class BlobDownload final : public grpc::ServerWriteReactor<frontend::GetBlobResponse>
+{
+    BlobCache& blob_cache_;
+    std::shared_ptr<AdmissionControl::Permit> permit_;
+    const std::string blob_hash_;
+    const std::chrono::milliseconds hedge_delay_;
+    uint64_t position_;
+    std::optional<uint64_t> end_;
+    frontend::GetBlobResponse response_;
+
+    std::shared_ptr<const std::string> cached_blob_;
+    std::string_view cached_range_;
+
+    uint64_t cache_generation_ = 0;
+    std::optional<std::string> blob_to_cache_;
+
+    grpc::ClientContext master_context_;
+    master::GetWorkerWithBlobRequest master_request_;
+    master::GetWorkerWithBlobResponse master_response_;
+    std::unique_ptr<master::MasterService::Stub> master_stub_;
+    std::vector<std::string> replicas_;
+    size_t next_replica_ = 0;
+
+    // The streams and the hedge timer refer to the reactor, it's deleted once all of them are done.
+    std::mutex mutex_;
+    std::vector<WorkerRead*> racing_; // streams waiting for their first chunk
+    WorkerRead* worker_ = nullptr;    // the stream that sent the first chunk, the blob is read from it
+    size_t workers_alive_ = 0;
+    std::unique_ptr<grpc::Alarm> hedge_alarm_;
+    bool hedge_pending_ = false;
+    bool cancelled_ = false;
+    bool finished_ = false;
+    bool reactor_done_ = false;
+    std::optional<std::string> error_;
+
+    void write_cached_chunk()
+    {
+        if (cached_range_.empty()) {
+            Finish(grpc::Status::OK);
+            return;
+        }
+        const auto size = std::min<size_t>(BlobStoreConfig::MAX_CHUNK_SIZE, cached_range_.size());
+        response_.set_chunk_data(cached_range_.data(), size);
+        response_.set_chunk_checksum(BlobHasher::checksum(response_.chunk_data()));
+        cached_range_.remove_prefix(size);
+        StartWrite(&response_);
+    }
+
+    void on_replicas(const grpc::Status& status)
+    {
+        if (!status.ok()) {
+            Logger::error("Failed to get workers with blob ", blob_hash_, ": ", status.error_message());
+            std::lock_guard lock(mutex_);
+            finish_locked(grpc::Status(grpc::CANCELLED, status.error_message()));
+            return;
+        }
+        replicas_.assign(master_response_.replicas().begin(), master_response_.replicas().end());
+        if (replicas_.empty()) {
+            replicas_.push_back(master_response_.addresses()); // master without the replicas field
+        }
+        Logger::info("Got ", replicas_.size(), " workers with the blob");
+        WorkerRead* worker;
+        {
+            std::lock_guard lock(mutex_);
+            worker = start_stream_locked();
+        }
+        if (worker) {
+            worker->start();
+        }
+    }
+
+    void finish_locked(const grpc::Status& status)
+    {
+        if (finished_) {
+            return;
+        }
+        finished_ = true;
+        for (auto* racing : racing_) {
+            racing->try_cancel();
+        }
+        if (hedge_pending_) {
+            hedge_alarm_->Cancel();
+        }
+        Finish(status);
+    }
+
+    /// Opens a stream at position_ on the next replica, to be started by the caller after unlocking.
+    /// While there are replicas left, the next one is asked too if no chunk comes within hedge_delay_.
+    /// Nullptr (and the call is finished) if there are no replicas left.
+    WorkerRead* start_stream_locked()
+    {
+        if (cancelled_ || next_replica_ >= replicas_.size()) {
+            finish_locked(grpc::Status(grpc::CANCELLED, cancelled_
+                ? "Cancelled by client."
+                : "All replicas failed to send blob " + blob_hash_));
+            return nullptr;
+        }
+        worker::GetBlobRequest request;
+        request.set_blob_hash(blob_hash_);
+        request.set_offset(position_);
+        if (end_) {
+            request.set_length(*end_ - position_);
+        }
+        auto* worker = new WorkerRead(*this, replicas_[next_replica_++], std::move(request));
+        racing_.push_back(worker);
+        workers_alive_++;
+        if (next_replica_ < replicas_.size() && !hedge_pending_) {
+            hedge_pending_ = true;
+            hedge_alarm_ = std::make_unique<grpc::Alarm>();
+            hedge_alarm_->Set(std::chrono::system_clock::now() + hedge_delay_, [this](const bool fired) { on_hedge(fired); });
+        }
+        return worker;
+    }
+
+    void on_hedge(const bool fired)
+    {
+        std::unique_lock lock(mutex_);
+        hedge_pending_ = false;
+        WorkerRead* worker = nullptr;
+        if (fired && !finished_ && !worker_ && !racing_.empty() && next_replica_ < replicas_.size()) {
+            Logger::info("No chunk of blob ", blob_hash_, " within ", hedge_delay_.count(), " ms, reading from another replica ",
+                         replicas_[next_replica_]);
+            worker = start_stream_locked();
+        }
+        release(lock);
+        if (worker) {
+            worker->start();
+        }
+    }
+
+    /// Deletes the reactor after the last one referring to it is done. Unlocks the lock.
+    void release(std::unique_lock<std::mutex>& lock)
+    {
+        const bool last = reactor_done_ && workers_alive_ == 0 && !hedge_pending_;
+        lock.unlock();
+        if (last) {
+            delete this;
+        }
+    }
+
+public:
+    BlobDownload(BlobCache& blob_cache, const FrontendConfig& config,
+                 std::shared_ptr<AdmissionControl::Permit> permit, const frontend::GetBlobRequest& request)
+        : blob_cache_(blob_cache), permit_(std::move(permit)), blob_hash_(request.blob_hash()),
+          hedge_delay_(config.hedge_delay_ms), position_(request.offset())
+    {
+        if ((cached_blob_ = blob_cache_.get(blob_hash_))) {
+            Logger::info("Serving blob ", blob_hash_, " from cache");
+            if (request.offset() > cached_blob_->size()) {
+                Finish(grpc::Status(grpc::OUT_OF_RANGE, "Offset is past the end of the blob."));
+                return;
+            }
+            cached_range_ = std::string_view(*cached_blob_).substr(
+                request.offset(), request.has_length() ? request.length() : std::string_view::npos);
+            write_cached_chunk();
+            return;
+        }
+
+        if (request.has_length()) {
+            end_ = position_ + std::min(request.length(), UINT64_MAX - position_);
+        }
+        // Small blobs are collected on the way, to be cached once fully read.
+        cache_generation_ = blob_cache_.generation();
+        if (request.offset() == 0 && !request.has_length()) {
+            blob_to_cache_.emplace();
+        }
+
+        master_request_.set_blob_hash(blob_hash_);
+        master_stub_ = ChannelPool::instance().stub<master::MasterService>(config.master_address_for(blob_hash_));
+        master_stub_->async()->GetWorkerWithBlob(&master_context_, &master_request_, &master_response_,
+                                                 [this](const grpc::Status& status) { on_replicas(status); });
+    }
+
+    void on_chunk(WorkerRead& worker)
+    {
+        auto& chunk_data = *worker.chunk.mutable_chunk_data();
+        const auto checksum = BlobHasher::checksum(chunk_data);
+        {
+            std::lock_guard lock(mutex_);
+            if (!worker_ && std::erase(racing_, &worker) > 0) {
+                // The first replica to send a chunk wins the race, the others are stopped.
+                worker_ = &worker;
+                for (auto* loser : racing_) {
+                    loser->try_cancel();
+                }
+                racing_.clear();
+                if (hedge_pending_) {
+                    hedge_alarm_->Cancel();
+                }
+            }
+            if (worker_ != &worker || finished_) {
+                worker.cancel(); // lost the race
+                return;
+            }
+            if (worker.chunk.has_chunk_checksum() && worker.chunk.chunk_checksum() != checksum) {
+                // Fails the stream, the read goes on from the next replica.
+                Logger::warn("Replica ", worker.address, " sent a corrupt chunk at byte ", position_, " of blob ", blob_hash_);
+                worker.cancel();
+                return;
+            }
+        }
+        position_ += chunk_data.size();
+        if (blob_to_cache_) {
+            if (blob_cache_.admits(blob_to_cache_->size() + chunk_data.size())) {
+                *blob_to_cache_ += chunk_data;
+            } else {
+                blob_to_cache_.reset();
+            }
+        }
+        response_.set_chunk_data(std::move(chunk_data));
+        response_.set_chunk_checksum(checksum);
+        StartWrite(&response_);
+    }
+
+    void OnWriteDone(const bool ok) override
+    {
+        if (cached_blob_) {
+            if (!ok) {
+                Finish(grpc::Status(grpc::CANCELLED, "Broken client write stream - can't write next chunk"));
+                return;
+            }
+            write_cached_chunk();
+            return;
+        }
+
+        std::lock_guard lock(mutex_);
+        if (!ok) {
+            error_ = "Broken client write stream - can't write next chunk";
+            worker_->cancel();
+            return;
+        }
+        worker_->read_next();
+    }
+
+    void on_worker_done(const WorkerRead& worker, const grpc::Status& status)
+    {
+        std::unique_lock lock(mutex_);
+        workers_alive_--;
+        const bool was_racing = std::erase(racing_, &worker) > 0;
+        const bool was_reading = worker_ == &worker;
+        if (was_reading) {
+            worker_ = nullptr;
+        }
+        WorkerRead* next = nullptr;
+        if (finished_ || (!was_racing && !was_reading)) {
+            // Finished already, or lost the race.
+        } else if (error_) {
+            finish_locked(grpc::Status(grpc::CANCELLED, *error_));
+        } else if (!status.ok()) {
+            Logger::warn("Replica ", worker.address, " failed at byte ", position_, " of blob ", blob_hash_,
+                         ": ", status.error_message());
+            // The streams still racing (hedges) may yet answer, otherwise the read goes on from the next replica.
+            if (racing_.empty()) {
+                next = start_stream_locked();
+            }
+        } else {
+            // A stream that ended without a chunk read an empty range.
+            if (blob_to_cache_ && (BlobHasher() += *blob_to_cache_).finalize() == blob_hash_) {
+                blob_cache_.put(blob_hash_, std::move(*blob_to_cache_), cache_generation_);
+            }
+            finish_locked(grpc::Status::OK);
+        }
+        release(lock);
+        if (next) {
+            next->start();
+        }
+    }
+
+    void OnCancel() override
+    {
+        std::lock_guard lock(mutex_);
+        cancelled_ = true;
+        master_context_.TryCancel();
+        if (worker_) {
+            worker_->try_cancel();
+        }
+        for (auto* racing : racing_) {
+            racing->try_cancel();
+        }
+    }
+
+    void OnDone() override
+    {
+        std::unique_lock lock(mutex_);
+        reactor_done_ = true;
+        release(lock);
+    }
+};
+
+void WorkerRead::OnReadDone(const bool ok)
+{
+    if (ok) {
+        download_.on_chunk(*this);
+    } else {
+        RemoveHold();
+    }
+}
+
+void WorkerRead::OnDone(const grpc::Status& status)
+{
+    download_.on_worker_done(*this, status);
+    delete this;
+}
+
+} // namespace
+
+// ---------------------------------- implementation ----------------------------------------------------
+
+grpc::ServerReadReactor<frontend::UploadBlobRequest>* FrontendCallbackServiceImpl::UploadBlob(
+    grpc::CallbackServerContext* context, frontend::UploadBlobResponse* response)
+{
+    Logger::info("Upload blob request received.");
+    // A reactor must not block, so there is no waiting for a slot here.
+    auto permit = admission_.try_admit(AdmissionControl::Kind::Upload, PIPELINED_UPLOAD_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return new RejectedCall<grpc::ServerReadReactor<frontend::UploadBlobRequest>>(permit.error());
+    }
+    return new BlobUpload(config_, permit.value(), response);
+}
+
+grpc::ServerWriteReactor<frontend::GetBlobResponse>* FrontendCallbackServiceImpl::GetBlob(
+    grpc::CallbackServerContext* context, const frontend::GetBlobRequest* request)
+{
+    Logger::info("GetBlob request");
+    auto permit = admission_.try_admit(AdmissionControl::Kind::Download, DOWNLOAD_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return new RejectedCall<grpc::ServerWriteReactor<frontend::GetBlobResponse>>(permit.error());
+    }
+    return new BlobDownload(blob_cache_, config_, permit.value(), *request);
+}
+
+grpc::ServerUnaryReactor* FrontendCallbackServiceImpl::DeleteBlob(grpc::CallbackServerContext* context,
+    const frontend::DeleteBlobRequest* request, frontend::DeleteBlobResponse* response)
+{
+    Logger::info("DeleteBlob request");
+    const auto& blob_hash = request->blob_hash();
+
+    struct MasterCall {
+        grpc::ClientContext context;
+        master::DeleteBlobRequest request;
+        master::DeleteBlobResponse response;
+        std::unique_ptr<master::MasterService::Stub> stub;
+    };
+    const auto call = std::make_shared<MasterCall>();
+    const auto master_address = config_.master_address_for(blob_hash);
+    call->request.set_blob_hash(blob_hash);
+    call->stub = ChannelPool::instance().stub<master::MasterService>(master_address);
+
+    Logger::info("Request to delete blob ", blob_hash, " from master at ", master_address);
+    auto* reactor = context->DefaultReactor();
+    call->stub->async()->DeleteBlob(&call->context, &call->request, &call->response,
+        [this, reactor, response, call](const grpc::Status& status) {
+            // Only after the delete: a GetBlob that started before could still put the blob back into the cache.
+            // Also when the delete failed, it may have got through on some of the workers.
+            blob_cache_.erase(call->request.blob_hash());
+            if (!status.ok()) {
+                Logger::error("Failed to delete request to master: ", status.error_message());
+                response->set_delete_result("Failed to delete request to master.");
+                reactor->Finish(grpc::Status::CANCELLED);
+                return;
+            }
+            response->set_delete_result("Blob deleted successfully.");
+            reactor->Finish(grpc::Status::OK);
+        });
+    return reactor;
+}
+
+grpc::ServerUnaryReactor* FrontendCallbackServiceImpl::HealthCheck(grpc::CallbackServerContext* context,
+    const frontend::HealthcheckRequest* request, frontend::HealthcheckResponse* response)
+{
+    Logger::info("Health check request logger \n");
+    Logger::info("Channel pool: ", ChannelPool::instance().stats().to_string());
+    auto* reactor = context->DefaultReactor();
+    reactor->Finish(grpc::Status::OK);
+    return reactor;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "services/master_service.grpc.pb.h"
+#include "services/frontend_service.grpc.pb.h"
+#include <grpc++/grpc++.h>
+#include "admission_control.hpp"
+#include "environment.hpp"
+#include "blob_cache.hpp"
+
+/// The frontend on the gRPC callback API. A call doesn't hold a thread while it waits for
+/// the client, the master or the workers - every step is a reaction to a finished operation,
+/// so the number of concurrent (slow) clients isn't limited by the size of a thread pool.
+/// - UploadBlob always streams the chunks to the workers right away (as with PIPELINED_UPLOAD),
+///   the next chunk is read from the client once all workers got the previous one,
+/// - GetBlob reads one chunk from a worker per chunk written to the client and fails over
+///   to the next replica if the worker breaks. A replica that doesn't send the first chunk within
+///   HEDGE_DELAY_MS is hedged by the next one (a timer), the first one to answer is read from.
+class FrontendCallbackServiceImpl final : public frontend::Frontend::CallbackService
+{
+    FrontendConfig config_;
+    BlobCache blob_cache_;
+    AdmissionControl admission_;
+public:
+    explicit FrontendCallbackServiceImpl(const FrontendConfig& config)
+        : config_(config),
+          blob_cache_(config.blob_cache_size_mb * 1024 * 1024, config.blob_cache_max_blob_kb * 1024),
+          admission_(AdmissionControl::options_from(config.admission)) {}
+
+    grpc::ServerReadReactor<frontend::UploadBlobRequest>* UploadBlob(
+        grpc::CallbackServerContext* context, frontend::UploadBlobResponse* response) override;
+
+    grpc::ServerWriteReactor<frontend::GetBlobResponse>* GetBlob(
+        grpc::CallbackServerContext* context, const frontend::GetBlobRequest* request) override;
+
+    grpc::ServerUnaryReactor* DeleteBlob(grpc::CallbackServerContext* context,
+        const frontend::DeleteBlobRequest* request, frontend::DeleteBlobResponse* response) override;
+
+    grpc::ServerUnaryReactor* HealthCheck(grpc::CallbackServerContext* context,
+        const frontend::HealthcheckRequest* request, frontend::HealthcheckResponse* response) override;
+};
@@ -3,6 +3,10 @@
 #include "expected.hpp"
 #include "blob_hasher.hpp"
 #include "blob_file.hpp"
+#include "channel_pool.hpp"
+#include "replica_fanout.hpp"
+#include "replica_reader.hpp"
+#include "upload_helpers.hpp"
 #include <fstream>
 #include <logging.hpp>
 #include <services/worker_service.grpc.pb.h>
@@ -15,26 +19,34 @@ static std::string operator""_S(const char* str, std::size_t) {
 }
 struct NetworkAddress : public std::string{};
 
+template<typename C>
+static auto f_const(C const_value){
+    return [const_value](auto x) { return const_value; };
+}
+
 auto send_blob_to_worker(const BlobFile& blob, const std::string& blob_hash,
-    const std::string& worker_address) -> Expected<std::monostate, std::string>
+    const std::string& worker_address, const std::vector<std::string>& chain) -> Expected<std::monostate, std::string>
 {
     Logger::info("Sending blob to worker at ", worker_address);
     try
     {
-        const auto worker_channel = grpc::CreateChannel(worker_address, grpc::InsecureChannelCredentials());
-        const auto worker_stub = worker::WorkerService::NewStub(worker_channel);
+        const auto worker_stub = ChannelPool::instance().stub<worker::WorkerService>(worker_address);
 
         grpc::ClientContext client_context;
         worker::SaveBlobResponse save_blob_response;
         Logger::debug("Starting to save blob ", blob_hash, " to worker");
         const auto writer = worker_stub->SaveBlob(&client_context, &save_blob_response);
 
+        bool first_chunk = true;
         for (const auto& chunk: blob)
         {
             Logger::debug("Saving next chunk of size ", chunk.size());
-            worker::SaveBlobRequest save_blob_request;
+            auto save_blob_request = first_chunk
+                ? first_save_blob_request(blob_hash, chain, blob.size())
+                : worker::SaveBlobRequest();
             save_blob_request.set_blob_hash(blob_hash);
             save_blob_request.set_chunk_data(chunk.data(), chunk.size());
+            first_chunk = false;
             if (!writer->Write(save_blob_request)) {
                 return "Failed to save blob to worker - broken stream";
             }
@@ -54,26 +66,31 @@ auto send_blob_to_worker(const BlobFile& blob, const std::string& blob_hash,
     }
 }
 
-auto receive_and_hash_blob(grpc::ServerReader<frontend::UploadBlobRequest>* reader)
-    -> Expected<std::pair<BlobFile, std::string>, grpc::Status>
+auto read_blob_info(grpc::ServerReader<frontend::UploadBlobRequest>* reader)
+    -> Expected<frontend::BlobInfo, grpc::Status>
 {
-    Logger::info("Receiving and hashing blob.");
     frontend::UploadBlobRequest request;
-
-    // 1. Read blob info
-    reader->Read(&request);
-    if (!request.has_info()) {
+    if (!reader->Read(&request) || !request.has_info()) {
         return grpc::Status(grpc::INVALID_ARGUMENT, "Request should start with blob info.");
     }
-    const auto blob_size = request.info().size_bytes();
-    Logger::info("Receiving blob of size ", blob_size);
+    Logger::info("Receiving blob of size ", request.info().size_bytes());
+    return request.info();
+}
+
+auto receive_and_hash_blob(grpc::ServerReader<frontend::UploadBlobRequest>* reader,
+    const frontend::BlobInfo& blob_info) -> Expected<std::pair<BlobFile, std::string>, grpc::Status>
+{
+    Logger::info("Receiving and hashing blob.");
+    frontend::UploadBlobRequest request;
+    const auto blob_size = blob_info.size_bytes();
 
-    // 2. Read chunks
     try
     {
         BlobHasher blob_hasher;
         auto blob_filename = "temp" + std::to_string(rand()) + ".blob";
         auto blob_file = BlobFile::New(blob_filename);
+        // The spool is temporary, so it doesn't need any durability, only the preallocation.
+        auto writer = blob_file.writer(BlobFile::Durability::None, blob_size);
         Logger::debug("Opened blob file for writing: ", blob_filename);
 
         while (reader->Read(&request))
@@ -83,14 +100,20 @@ auto receive_and_hash_blob(grpc::ServerReader<frontend::UploadBlobRequest>* read
             }
 
             Logger::debug("Received chunk of size ", request.chunk_data().size());
-            blob_file.append_chunk(request.chunk_data());
+            writer.append(request.chunk_data());
             blob_hasher.add_chunk(request.chunk_data());
         }
+        writer.commit();
 
         auto blob_hash = blob_hasher.finalize();
         if (blob_file.size() != blob_size) {
             return grpc::Status(grpc::INVALID_ARGUMENT, "Blob file size mismatch.");
         }
+        if (blob_info.has_blob_hash() && blob_info.blob_hash() != blob_hash) {
+            Logger::error("Blob hash mismatch: ", blob_info.blob_hash(), " != ", blob_hash);
+            blob_file.remove();
+            return grpc::Status(grpc::INVALID_ARGUMENT, "Blob hash doesn't match the hash in blob info.");
+        }
 
         Logger::info("Blob fully received and hashed: ", blob_hash);
         return std::make_pair(blob_file, blob_hash);
@@ -101,16 +124,60 @@ auto receive_and_hash_blob(grpc::ServerReader<frontend::UploadBlobRequest>* read
     }
 }
 
-auto get_workers_from_master(std::string blob_hash, const std::string& master_address)
+// Receives the chunks and streams each of them to all workers right away, hashing in the same pass.
+// The workers keep the blob under upload_id until they get the commit with the final hash.
+auto receive_and_fan_out_blob(grpc::ServerReader<frontend::UploadBlobRequest>* reader,
+    const frontend::BlobInfo& blob_info, const UploadTargets& targets, const std::string& upload_id)
+    -> Expected<std::string, grpc::Status>
+{
+    Logger::info("Streaming upload ", upload_id, " to workers ", targets.workers, " (chain: ", targets.chain, ")");
+    ReplicaFanout fanout(targets.workers, first_save_blob_request(upload_id, targets.chain, blob_info.size_bytes()),
+                         BlobStoreConfig::UPLOAD_WINDOW_CHUNKS);
+    BlobHasher blob_hasher;
+    uint64_t received_bytes = 0;
+
+    frontend::UploadBlobRequest request;
+    while (reader->Read(&request))
+    {
+        if (!request.has_chunk_data()) {
+            return grpc::Status(grpc::INVALID_ARGUMENT, "Request missing chunk data.");
+        }
+
+        Logger::debug("Received chunk of size ", request.chunk_data().size());
+        blob_hasher.add_chunk(request.chunk_data());
+        received_bytes += request.chunk_data().size();
+        if (auto pushed = fanout.push(std::move(*request.mutable_chunk_data())); !pushed.has_value()) {
+            return grpc::Status(grpc::CANCELLED, pushed.error());
+        }
+    }
+
+    auto blob_hash = blob_hasher.finalize();
+    if (received_bytes != blob_info.size_bytes()) {
+        return grpc::Status(grpc::INVALID_ARGUMENT, "Blob file size mismatch.");
+    }
+    if (blob_info.has_blob_hash() && blob_info.blob_hash() != blob_hash) {
+        Logger::error("Blob hash mismatch: ", blob_info.blob_hash(), " != ", blob_hash);
+        return grpc::Status(grpc::INVALID_ARGUMENT, "Blob hash doesn't match the hash in blob info.");
+    }
+    if (auto committed = fanout.commit(blob_hash); !committed.has_value()) {
+        return grpc::Status(grpc::CANCELLED, committed.error());
+    }
+
+    Logger::info("Blob fully received and saved to workers: ", blob_hash);
+    return blob_hash;
+}
+
+auto get_workers_from_master(std::string blob_hash, const uint64_t size_mb, const std::string& master_address)
     -> Expected<std::vector<std::string>, grpc::Status>
 {
     Logger::info("Requesting workers from master at ", master_address);
-    const auto master_stub = master::MasterService::NewStub(grpc::CreateChannel(master_address, grpc::InsecureChannelCredentials()));
+    const auto master_stub = ChannelPool::instance().stub<master::MasterService>(master_address);
     //google::protobuf::RepeatedPtrField<common::ipv4Address>
     // Ask master for workers to store blob.
     grpc::ClientContext client_context;
     master::GetWorkersToSaveBlobRequest get_workers_request;
     get_workers_request.set_blob_hash(blob_hash);
+    get_workers_request.set_size_mb(size_mb);
     master::GetWorkersToSaveBlobResponse get_workers_response;
     if (const auto status = master_stub->GetWorkersToSaveBlob(&client_context, get_workers_request,
                                                               &get_workers_response); !status.ok()) {
@@ -122,21 +189,49 @@ auto get_workers_from_master(std::string blob_hash, const std::string& master_ad
     return addresses;
 }
 
-auto get_worker_with_blob_id(std::string blob_id, const std::string& master_address)
-    -> Expected<NetworkAddress, std::string>
+auto get_workers_with_blob(const std::string& blob_hash, const std::string& master_address)
+    -> Expected<std::vector<std::string>, std::string>
 {
-    Logger::info("Getting worker with blob id ", blob_id, " from master at ", master_address);
+    Logger::info("Getting workers with blob ", blob_hash, " from master at ", master_address);
     master::GetWorkerWithBlobRequest request;
-    request.set_blob_hash(blob_id);
+    request.set_blob_hash(blob_hash);
     master::GetWorkerWithBlobResponse response;
     grpc::ClientContext client_context;
 
-    const auto master_stub_ = master::MasterService::NewStub(grpc::CreateChannel(master_address, grpc::InsecureChannelCredentials()));
+    const auto master_stub_ = ChannelPool::instance().stub<master::MasterService>(master_address);
     if (const auto status = master_stub_->GetWorkerWithBlob(&client_context, request, &response); !status.ok()) {
         return status.error_message();
     }
-    Logger::info("Got worker address");
-    return NetworkAddress(response.addresses());
+    std::vector<std::string> replicas(response.replicas().begin(), response.replicas().end());
+    if (replicas.empty()) {
+        replicas.push_back(response.addresses()); // master without the replicas field
+    }
+    Logger::info("Got ", replicas.size(), " workers with the blob");
+    return replicas;
+}
+
+/// True if the master knows enough saved copies of the blob, so it doesn't have to be uploaded again.
+auto is_blob_stored(const std::string& blob_hash, const std::string& master_address) -> bool
+{
+    return get_workers_with_blob(blob_hash, master_address)
+    .output<bool>(
+        [](const auto& replicas) { return std::ssize(replicas) >= BlobStoreConfig::REPLICATION_FACTOR; },
+        f_const(false)
+    );
+}
+
+auto send_cached_blob(const std::string_view blob, grpc::ServerWriter<frontend::GetBlobResponse>* writer)
+    -> Expected<std::monostate, std::string>
+{
+    frontend::GetBlobResponse response;
+    for (uint64_t pos = 0; pos < blob.size(); pos += BlobStoreConfig::MAX_CHUNK_SIZE) {
+        response.set_chunk_data(blob.data() + pos, std::min(BlobStoreConfig::MAX_CHUNK_SIZE, blob.size() - pos));
+        response.set_chunk_checksum(BlobHasher::checksum(response.chunk_data()));
+        if (!writer->Write(response)) {
+            return "Broken client write stream - can't write next chunk";
+        }
+    }
+    return std::monostate();
 }
 
 static std::string failed_request(const std::string& error_message, const std::string& performed_action) {
@@ -150,17 +245,42 @@ grpc::Status FrontendServiceImpl::UploadBlob(grpc::ServerContext* context,
     grpc::ServerReader<frontend::UploadBlobRequest>* reader, frontend::UploadBlobResponse* response)
 {
     Logger::info("Upload blob request received.");
+    const auto permit = admission_.admit(AdmissionControl::Kind::Upload, config_.pipelined_upload
+                                         ? PIPELINED_UPLOAD_BUFFER_BYTES : SPOOLED_UPLOAD_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return permit.error();
+    }
+    const auto blob_info = read_blob_info(reader);
+    if (!blob_info.has_value()) {
+        return blob_info.error();
+    }
+
+    // Blobs are content-addressed, a blob that is already stored doesn't need the data again.
+    if (const auto& claimed_hash = blob_info.value().blob_hash(); blob_info.value().has_blob_hash() &&
+        is_blob_stored(claimed_hash, get_master_service_address_based_on_hash(claimed_hash))) {
+        Logger::info("Blob ", claimed_hash, " is already stored, skipping the upload.");
+        response->set_blob_hash(claimed_hash);
+        response->set_deduplicated(true);
+        return grpc::Status::OK;
+    }
+
+    if (config_.pipelined_upload) {
+        return upload_blob_pipelined(reader, blob_info.value(), response);
+    }
+
     // Receive and hash the blob in chunks.
-    return receive_and_hash_blob(reader)
+    return receive_and_hash_blob(reader, blob_info.value())
     .and_then([&](auto filehash)->Expected<int, grpc::Status> {
 
     auto &[blob_file, blob_hash] = filehash;
     Logger::info("Received blob with hash ", blob_hash);
-    return get_workers_from_master(blob_hash, get_master_service_address_based_on_hash(blob_hash))
+    return get_workers_from_master(blob_hash, size_in_mb(blob_file.size()),
+                                   get_master_service_address_based_on_hash(blob_hash))
     .and_then([&](const auto& workers)->Expected<int, grpc::Status>{
 
-    for (const auto& worker_address : workers) {
-        auto send_blob_result = send_blob_to_worker(blob_file, blob_hash, worker_address);
+    const auto targets = upload_targets(workers, chain_replication());
+    for (const auto& worker_address : targets.workers) {
+        auto send_blob_result = send_blob_to_worker(blob_file, blob_hash, worker_address, targets.chain);
         if (not send_blob_result.has_value()) {
             Logger::info("Saving blob to worker ", worker_address, " failed: ", send_blob_result.error());
             return grpc::Status(grpc::CANCELLED, send_blob_result.error());
@@ -178,37 +298,82 @@ grpc::Status FrontendServiceImpl::UploadBlob(grpc::ServerContext* context,
     );
 }
 
-template<typename C>
-static auto f_const(C const_value){
-    return [const_value](auto x) { return const_value; };
+grpc::Status FrontendServiceImpl::upload_blob_pipelined(grpc::ServerReader<frontend::UploadBlobRequest>* reader,
+    const frontend::BlobInfo& blob_info, frontend::UploadBlobResponse* response) const
+{
+    // The hash is known only at the end, so the blob is placed under a temporary upload id.
+    const auto upload_id = new_upload_id();
+    return get_workers_from_master(upload_id, size_in_mb(blob_info.size_bytes()),
+                                   get_master_service_address_based_on_hash(upload_id))
+    .and_then([&](const auto& workers)->Expected<std::string, grpc::Status> {
+        return receive_and_fan_out_blob(reader, blob_info, upload_targets(workers, chain_replication()), upload_id);
+    })
+
+    .output<grpc::Status>(
+        [&](const std::string& blob_hash) { response->set_blob_hash(blob_hash); return grpc::Status::OK; },
+        [](auto err) { Logger::error("Pipelined upload failed: ", err.error_message()); return err; }
+    );
 }
 
 grpc::Status FrontendServiceImpl::GetBlob(grpc::ServerContext* context, const frontend::GetBlobRequest* request,
                                           grpc::ServerWriter<frontend::GetBlobResponse>* writer)
 {
     Logger::info("GetBlob request");
+    const auto permit = admission_.admit(AdmissionControl::Kind::Download, DOWNLOAD_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return permit.error();
+    }
     const auto& blob_id = request->blob_hash();
 
-    return get_worker_with_blob_id(blob_id, get_master_service_address_based_on_hash(blob_id))
-    .and_then([&](const NetworkAddress& worker_address)->Expected<std::monostate, std::string> {
-        const auto worker_channel = grpc::CreateChannel(worker_address, grpc::InsecureChannelCredentials());
-        const auto worker_stub = worker::WorkerService::NewStub(worker_channel);
-
-        worker::GetBlobRequest worker_request;
-        worker_request.set_blob_hash(blob_id);
-        grpc::ClientContext client_context;
-
-        const auto reader = worker_stub->GetBlob(&client_context, worker_request);
-
+    if (const auto cached_blob = blob_cache_.get(blob_id)) {
+        Logger::info("Serving blob ", blob_id, " from cache");
+        if (request->offset() > cached_blob->size()) {
+            return grpc::Status(grpc::OUT_OF_RANGE, "Offset is past the end of the blob.");
+        }
+        const auto range = std::string_view(*cached_blob).substr(
+            request->offset(), request->has_length() ? request->length() : std::string_view::npos);
+        return send_cached_blob(range, writer)
+        .output<grpc::Status>(
+            f_const(grpc::Status::OK),
+            [](const auto& error_str) { return grpc::Status(grpc::StatusCode::CANCELLED, error_str); }
+        );
+    }
+    const auto cache_generation = blob_cache_.generation();
+
+    return get_workers_with_blob(blob_id, get_master_service_address_based_on_hash(blob_id))
+    .and_then([&](const std::vector<std::string>& replicas)->Expected<std::monostate, std::string> {
+        const auto length = request->has_length() ? std::optional(request->length()) : std::nullopt;
+        ReplicaReader replica_reader(blob_id, replicas, request->offset(), length,
+                                     std::chrono::milliseconds(config_.hedge_delay_ms),
+                                     std::chrono::milliseconds(config_.read_idle_timeout_ms));
+
+        // Small blobs are collected on the way, to be cached once fully read.
+        const bool whole_blob = request->offset() == 0 && !request->has_length();
+        auto blob_to_cache = whole_blob ? std::optional<std::string>(std::string()) : std::nullopt;
         frontend::GetBlobResponse response;
-        worker::GetBlobResponse worker_response;
-        while (reader->Read(&worker_response)) {
-            response.set_chunk_data(worker_response.chunk_data());
+        auto read_result = replica_reader.read([&](std::string& chunk, const std::optional<uint64_t> checksum)
+            -> Expected<std::monostate, std::string> {
+            if (blob_to_cache) {
+                if (blob_cache_.admits(blob_to_cache->size() + chunk.size())) {
+                    *blob_to_cache += chunk;
+                } else {
+                    blob_to_cache.reset();
+                }
+            }
+            response.set_chunk_data(std::move(chunk));
+            response.set_chunk_checksum(checksum ? *checksum : BlobHasher::checksum(response.chunk_data()));
             if (!writer->Write(response)) {
                 return "Broken client write stream - can't write next chunk";
             }
+            return std::monostate();
+        });
+        if (!read_result.has_value()) {
+            return read_result;
         }
 
+        if (blob_to_cache && (BlobHasher() += *blob_to_cache).finalize() == blob_id) {
+            blob_cache_.put(blob_id, std::move(*blob_to_cache), cache_generation);
+        }
         return std::monostate();
     })
 
@@ -224,15 +389,18 @@ grpc::Status FrontendServiceImpl::DeleteBlob(grpc::ServerContext* context, const
     Logger::info("DeleteBlob request");
     auto blob_hash = request->blob_hash();
     auto master_address = get_master_service_address_based_on_hash(blob_hash);
-    const auto master_stub_ = master::MasterService::NewStub(grpc::CreateChannel(master_address, grpc::InsecureChannelCredentials()));
+    const auto master_stub_ = ChannelPool::instance().stub<master::MasterService>(master_address);
     grpc::ClientContext client_context;
     master::DeleteBlobResponse master_response;
     master::DeleteBlobRequest master_request;
     master_request.set_blob_hash(blob_hash);
 
     Logger::info("Request to delete blob ", blob_hash, " from master at ", master_address);
-    if (const auto master_status = master_stub_->DeleteBlob(&client_context, master_request, &master_response);
-        not master_status.ok()) {
+    const auto master_status = master_stub_->DeleteBlob(&client_context, master_request, &master_response);
+    // Only after the delete: a GetBlob that started before could still put the blob back into the cache.
+    // Also when the delete failed, it may have got through on some of the workers.
+    blob_cache_.erase(blob_hash);
+    if (not master_status.ok()) {
         response->set_delete_result(failed_request(master_status.error_message(),
                                                    "delete request to master"));
         return grpc::Status::CANCELLED;
@@ -246,5 +414,6 @@ grpc::Status FrontendServiceImpl::HealthCheck(grpc::ServerContext* context, cons
     frontend::HealthcheckResponse* response)
 {
     Logger::info("Health check request logger \n");
+    Logger::info("Channel pool: ", ChannelPool::instance().stats().to_string());
     return grpc::Status::OK;
 }
\ No newline at end of file
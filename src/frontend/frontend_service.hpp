@@ -2,16 +2,30 @@
 #include "services/master_service.grpc.pb.h"
 #include "services/frontend_service.grpc.pb.h"
 #include <grpc++/grpc++.h>
+#include "admission_control.hpp"
+#include "environment.hpp"
+#include "blob_cache.hpp"
 
 class FrontendServiceImpl final : public frontend::Frontend::Service
 {
-    int masters_count_;
+    FrontendConfig config_;
+    BlobCache blob_cache_;
+    AdmissionControl admission_;
     [[nodiscard]] std::string get_master_service_address_based_on_hash(const std::string& hash) const {
-        const auto idx = std::hash<std::string>{}(hash) % masters_count_;
-        return "master-" + std::to_string(idx) + ".master-service:50042";
+        return config_.master_address_for(hash);
     }
+    [[nodiscard]] bool chain_replication() const {
+        return config_.replication_mode == FrontendConfig::ReplicationMode::Chain;
+    }
+
+    grpc::Status upload_blob_pipelined(grpc::ServerReader<frontend::UploadBlobRequest>* reader,
+                                       const frontend::BlobInfo& blob_info,
+                                       frontend::UploadBlobResponse* response) const;
 public:
-    explicit FrontendServiceImpl(const int masters_count): masters_count_(masters_count) {}
+    explicit FrontendServiceImpl(const FrontendConfig& config)
+        : config_(config),
+          blob_cache_(config.blob_cache_size_mb * 1024 * 1024, config.blob_cache_max_blob_kb * 1024),
+          admission_(AdmissionControl::options_from(config.admission)) {}
 
     grpc::Status UploadBlob(grpc::ServerContext* context, grpc::ServerReader<frontend::UploadBlobRequest>* reader,
                             frontend::UploadBlobResponse* response) override;
@@ -1,8 +1,10 @@
 #include "frontend_service.hpp"
+#include "frontend_callback_service.hpp"
 #include <iostream>
 #include <memory>
 #include <string>
 #include <grpc++/grpc++.h>
+#include "admission_control.hpp"
 #include "environment.hpp"
 #include "logging.hpp"
 
@@ -11,16 +13,26 @@ void run_frontend(const FrontendConfig& config)
     const std::string container_port = std::to_string(config.container_port);
     const std::string server_address = "0.0.0.0:" + container_port;
 
-    FrontendServiceImpl frontend_service(config.masters_count);
+    const bool callback_mode = config.server_mode == FrontendConfig::ServerMode::Callback;
+    std::unique_ptr<grpc::Service> frontend_service;
+    if (callback_mode) {
+        frontend_service = std::make_unique<FrontendCallbackServiceImpl>(config);
+    } else {
+        frontend_service = std::make_unique<FrontendServiceImpl>(config);
+    }
 
+    grpc::ServerBuilder builder;
+    AdmissionControl::configure(builder, AdmissionControl::options_from(config.admission), "frontend");
     const auto server =
-        grpc::ServerBuilder()
+        builder
         .AddListeningPort(server_address, grpc::InsecureServerCredentials())
-        .RegisterService(&frontend_service)
+        .RegisterService(frontend_service.get())
         .BuildAndStart();
 
     Logger::info("Frontend service is running on ", server_address);
     Logger::info("There are ", config.masters_count, " masters. ");
+    Logger::info("Server mode: ", callback_mode ? "callback" : "sync");
+    Logger::info("Pipelined upload: ", callback_mode || config.pipelined_upload ? "on" : "off");
     server->Wait();
 }
 
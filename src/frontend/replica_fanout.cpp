@@ -0,0 +1,174 @@
+#include "replica_fanout.hpp"
+#include "channel_pool.hpp"
+#include "logging.hpp"
+#include "upload_helpers.hpp"
+
+// ------------------------------------ replica ---------------------------------------------------------
+
+ReplicaFanout::Replica::Replica(const std::string& address, const worker::SaveBlobRequest& first_request)
+    : address_(address), first_request_(first_request)
+{
+    stub_ = ChannelPool::instance().stub<worker::WorkerService>(address_);
+    writer_ = stub_->SaveBlob(&client_context_, &response_);
+    sender_ = std::thread([this] { send_loop(); });
+}
+
+ReplicaFanout::Replica::~Replica()
+{
+    worker::SaveBlobCommit abort;
+    abort.set_abort(true);
+    close(abort);
+    if (sender_.joinable()) {
+        sender_.join();
+    }
+}
+
+void ReplicaFanout::Replica::send_loop()
+{
+    auto request = first_request_;
+    while (true) {
+        std::shared_ptr<const std::string> chunk;
+        {
+            std::unique_lock lock(mutex_);
+            queue_changed_.wait(lock, [&] { return !queue_.empty() || commit_; });
+            if (queue_.empty()) {
+                break;
+            }
+            chunk = queue_.front();
+            queue_.pop_front();
+        }
+        queue_changed_.notify_all();
+
+        request.set_chunk_data(*chunk);
+        if (!writer_->Write(request)) {
+            std::lock_guard lock(mutex_);
+            Logger::error("Failed to send chunk of upload ", request.blob_hash(), " to worker ", address_);
+            error_ = "Failed to save blob to worker " + address_ + " - broken stream";
+            queue_.clear();
+            queue_changed_.notify_all();
+            break;
+        }
+        clear_first_message_fields(request);
+    }
+
+    std::optional<worker::SaveBlobCommit> commit;
+    {
+        std::lock_guard lock(mutex_);
+        if (!error_) {
+            commit = commit_;
+        }
+    }
+    if (commit) {
+        request.clear_chunk_data();
+        *request.mutable_commit() = *commit;
+        writer_->Write(request);
+    }
+    writer_->WritesDone();
+    const auto status = writer_->Finish();
+
+    std::lock_guard lock(mutex_);
+    if (!status.ok() && !(commit && commit->abort())) {
+        error_ = "Worker " + address_ + ": " + status.error_message();
+    }
+}
+
+auto ReplicaFanout::Replica::push(const std::shared_ptr<const std::string>& chunk, const size_t window)
+    -> Expected<std::monostate, std::string>
+{
+    std::unique_lock lock(mutex_);
+    queue_changed_.wait(lock, [&] { return queue_.size() < window || error_; });
+    if (error_) {
+        return *error_;
+    }
+    queue_.push_back(chunk);
+    lock.unlock();
+    queue_changed_.notify_all();
+    return std::monostate{};
+}
+
+void ReplicaFanout::Replica::close(const worker::SaveBlobCommit& commit)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (commit_) {
+            return;
+        }
+        if (commit.abort()) {
+            queue_.clear();
+        }
+        commit_ = commit;
+    }
+    queue_changed_.notify_all();
+}
+
+auto ReplicaFanout::Replica::wait() -> Expected<std::monostate, std::string>
+{
+    if (sender_.joinable()) {
+        sender_.join();
+    }
+    if (error_) {
+        return *error_;
+    }
+    return std::monostate{};
+}
+
+// ------------------------------------ fanout ----------------------------------------------------------
+
+ReplicaFanout::ReplicaFanout(const std::vector<std::string>& worker_addresses,
+                             const worker::SaveBlobRequest& first_request, const size_t window)
+    : window_(window)
+{
+    for (const auto& address : worker_addresses) {
+        replicas_.push_back(std::make_unique<Replica>(address, first_request));
+    }
+}
+
+ReplicaFanout::~ReplicaFanout()
+{
+    abort();
+}
+
+auto ReplicaFanout::push(std::string chunk) -> Expected<std::monostate, std::string>
+{
+    // All replicas share one copy of the chunk.
+    const auto shared_chunk = std::make_shared<const std::string>(std::move(chunk));
+    for (const auto& replica : replicas_) {
+        auto pushed = replica->push(shared_chunk, window_);
+        if (!pushed.has_value()) {
+            return pushed;
+        }
+    }
+    return std::monostate{};
+}
+
+auto ReplicaFanout::close(const worker::SaveBlobCommit& commit) -> Expected<std::monostate, std::string>
+{
+    closed_ = true;
+    for (const auto& replica : replicas_) {
+        replica->close(commit);
+    }
+    Expected<std::monostate, std::string> result = std::monostate{};
+    for (const auto& replica : replicas_) {
+        if (auto finished = replica->wait(); !finished.has_value() && result.has_value()) {
+            result = finished;
+        }
+    }
+    return result;
+}
+
+auto ReplicaFanout::commit(const std::string& blob_hash) -> Expected<std::monostate, std::string>
+{
+    worker::SaveBlobCommit commit;
+    commit.set_blob_hash(blob_hash);
+    return close(commit);
+}
+
+void ReplicaFanout::abort()
+{
+    if (closed_) {
+        return;
+    }
+    worker::SaveBlobCommit abort;
+    abort.set_abort(true);
+    close(abort);
+}
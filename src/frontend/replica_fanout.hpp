@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "services/worker_service.grpc.pb.h"
+#include "expected.hpp"
+
+/// Streams one blob to several workers at the same time.
+/// Every pushed chunk is queued for all replicas and each replica is sent by its own thread,
+/// so a slow worker stalls the upload only when its queue is full (holds `window` chunks).
+/// The chunks are sent under a temporary upload id - the final message tells the workers
+/// the real hash of the blob and whether to commit or abort it.
+/// Example usage:
+///   ReplicaFanout fanout(workers, first_save_blob_request(upload_id, chain, blob_size), window);
+///   fanout.push(chunk_0);
+///   fanout.push(chunk_1);
+///   fanout.commit(blob_hash);
+class ReplicaFanout {
+    class Replica {
+        std::string address_;
+        worker::SaveBlobRequest first_request_;
+        grpc::ClientContext client_context_;
+        worker::SaveBlobResponse response_;
+        std::unique_ptr<worker::WorkerService::Stub> stub_;
+        std::unique_ptr<grpc::ClientWriter<worker::SaveBlobRequest>> writer_;
+
+        std::mutex mutex_;
+        std::condition_variable queue_changed_;
+        std::deque<std::shared_ptr<const std::string>> queue_;
+        std::optional<worker::SaveBlobCommit> commit_;
+        std::optional<std::string> error_;
+        std::thread sender_;
+
+        void send_loop();
+    public:
+        Replica(const std::string& address, const worker::SaveBlobRequest& first_request);
+        ~Replica();
+
+        auto push(const std::shared_ptr<const std::string>& chunk, size_t window) -> Expected<std::monostate, std::string>;
+        void close(const worker::SaveBlobCommit& commit);
+        auto wait() -> Expected<std::monostate, std::string>;
+    };
+
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    size_t window_;
+    bool closed_ = false;
+
+    auto close(const worker::SaveBlobCommit& commit) -> Expected<std::monostate, std::string>;
+public:
+    /// first_request: the upload id and the fields sent only in the first message (the chain, the size).
+    ReplicaFanout(const std::vector<std::string>& worker_addresses, const worker::SaveBlobRequest& first_request,
+                  size_t window);
+    ~ReplicaFanout();
+
+    ReplicaFanout(const ReplicaFanout&) = delete;
+    ReplicaFanout& operator=(const ReplicaFanout&) = delete;
+
+    /// Queues the chunk for all replicas, blocks while any of the queues is full.
+    /// Fails if one of the replicas has already failed.
+    auto push(std::string chunk) -> Expected<std::monostate, std::string>;
+
+    /// Tells all replicas to save the blob under blob_hash and waits until they finish.
+    auto commit(const std::string& blob_hash) -> Expected<std::monostate, std::string>;
+
+    /// Drops the queued chunks and tells all replicas to discard the blob.
+    void abort();
+};
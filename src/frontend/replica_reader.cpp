@@ -0,0 +1,218 @@
+#include "replica_reader.hpp"
+#include <algorithm>
+#include "blob_hasher.hpp"
+#include "channel_pool.hpp"
+#include "logging.hpp"
+
+ReplicaReader::Attempt::Attempt(const std::chrono::milliseconds idle_timeout) : idle_timeout_(idle_timeout)
+{
+    watchdog = std::thread([this] {
+        std::unique_lock lock(watchdog_mutex);
+        while (!watchdog_stopped) {
+            if (!read_deadline) {
+                watchdog_wakeup.wait(lock);
+                continue;
+            }
+            const auto deadline = *read_deadline;
+            if (watchdog_wakeup.wait_until(lock, deadline) == std::cv_status::timeout && read_deadline == deadline) {
+                stalled = true;
+                context.TryCancel();
+                return;
+            }
+        }
+    });
+}
+
+ReplicaReader::Attempt::~Attempt()
+{
+    if (first_read.joinable()) {
+        first_read.join();
+    }
+    {
+        std::lock_guard lock(watchdog_mutex);
+        watchdog_stopped = true;
+    }
+    watchdog_wakeup.notify_all();
+    watchdog.join();
+}
+
+void ReplicaReader::Attempt::set_read_deadline(const std::optional<std::chrono::steady_clock::time_point> deadline)
+{
+    {
+        std::lock_guard lock(watchdog_mutex);
+        read_deadline = deadline;
+    }
+    watchdog_wakeup.notify_all();
+}
+
+bool ReplicaReader::Attempt::open(const worker::GetBlobRequest& request)
+{
+    // The idle timeout covers connecting too.
+    set_read_deadline(std::chrono::steady_clock::now() + idle_timeout_);
+    reader = stub->GetBlob(&context, request);
+    const bool ok = reader->Read(&first_chunk);
+    set_read_deadline(std::nullopt);
+    return ok;
+}
+
+bool ReplicaReader::Attempt::read(worker::GetBlobResponse& response)
+{
+    // Only the wait for the replica counts, not the time the consumer takes with the previous chunk.
+    set_read_deadline(std::chrono::steady_clock::now() + idle_timeout_);
+    const bool ok = reader->Read(&response);
+    set_read_deadline(std::nullopt);
+    return ok;
+}
+
+void ReplicaReader::Attempt::cancel()
+{
+    context.TryCancel();
+    if (first_read.joinable()) {
+        first_read.join();
+    }
+    worker::GetBlobResponse ignored;
+    while (reader->Read(&ignored)) {}
+    reader->Finish();
+}
+
+ReplicaReader::ReplicaReader(std::string blob_hash, std::vector<std::string> replicas, const uint64_t offset,
+                             const std::optional<uint64_t> length, const std::chrono::milliseconds hedge_delay,
+                             const std::chrono::milliseconds idle_timeout)
+    : blob_hash_(std::move(blob_hash)), replicas_(std::move(replicas)), position_(offset), hedge_delay_(hedge_delay),
+      idle_timeout_(idle_timeout)
+{
+    if (length) {
+        end_ = offset + std::min(*length, UINT64_MAX - offset);
+    }
+}
+
+auto ReplicaReader::start_attempt() -> std::shared_ptr<Attempt>
+{
+    auto attempt = std::make_shared<Attempt>(idle_timeout_);
+    attempt->address = replicas_[next_replica_++];
+    attempt->stub = ChannelPool::instance().stub<worker::WorkerService>(attempt->address);
+
+    worker::GetBlobRequest request;
+    request.set_blob_hash(blob_hash_);
+    request.set_offset(position_);
+    if (end_) {
+        request.set_length(*end_ - position_);
+    }
+
+    // Even opening the stream may block (e.g. while connecting), so it's done in the thread as well.
+    attempt->first_read = std::thread([this, attempt = attempt.get(), request] {
+        const bool got_first_chunk = attempt->open(request);
+
+        std::lock_guard lock(mutex_);
+        attempt->got_first_chunk = got_first_chunk;
+        attempt->first_read_done = true;
+        first_read_done_.notify_all();
+    });
+    return attempt;
+}
+
+auto ReplicaReader::open_stream() -> Expected<std::shared_ptr<Attempt>, std::string>
+{
+    if (next_replica_ >= replicas_.size()) {
+        return "No replica left to read blob " + blob_hash_ + " from";
+    }
+
+    std::vector<std::shared_ptr<Attempt>> racing{start_attempt()};
+    auto hedge_at = std::chrono::steady_clock::now() + hedge_delay_;
+    while (true) {
+        const auto is_done = [](const auto& attempt) { return attempt->first_read_done; };
+        std::vector<std::shared_ptr<Attempt>> done;
+        {
+            std::unique_lock lock(mutex_);
+            const auto any_done = [&] { return std::ranges::any_of(racing, is_done); };
+            if (next_replica_ < replicas_.size()) {
+                first_read_done_.wait_until(lock, hedge_at, any_done);
+            } else {
+                first_read_done_.wait(lock, any_done);
+            }
+            std::ranges::copy_if(racing, std::back_inserter(done), is_done);
+            std::erase_if(racing, is_done);
+        }
+
+        std::shared_ptr<Attempt> winner;
+        for (const auto& attempt : done) {
+            attempt->first_read.join();
+            if (winner) {
+                attempt->cancel();
+                continue;
+            }
+            // A stream that ended before the first chunk is either an empty range or an error.
+            if (attempt->got_first_chunk) {
+                winner = attempt;
+            } else if (const auto status = attempt->reader->Finish(); status.ok()) {
+                winner = attempt;
+            } else {
+                Logger::warn("Reading blob ", blob_hash_, " from ", attempt->address, " failed: ", status.error_message());
+            }
+        }
+
+        if (winner) {
+            for (const auto& loser : racing) {
+                loser->cancel();
+            }
+            return winner;
+        }
+
+        const bool hedge = std::chrono::steady_clock::now() >= hedge_at;
+        if (next_replica_ >= replicas_.size()) {
+            if (racing.empty()) {
+                return "All replicas failed to send blob " + blob_hash_;
+            }
+        } else if (racing.empty() || hedge) {
+            Logger::info("Reading blob ", blob_hash_, " from another replica ", replicas_[next_replica_]);
+            racing.push_back(start_attempt());
+            hedge_at = std::chrono::steady_clock::now() + hedge_delay_;
+        }
+    }
+}
+
+auto ReplicaReader::read(const ChunkConsumer& consume) -> Expected<std::monostate, std::string>
+{
+    while (true) {
+        auto stream = open_stream();
+        if (!stream.has_value()) {
+            return stream.error();
+        }
+        const auto attempt = stream.value();
+        if (!attempt->got_first_chunk) {
+            return std::monostate{}; // nothing to read, the stream is already finished
+        }
+
+        auto& response = attempt->first_chunk;
+        bool corrupt = false;
+        do {
+            if (response.has_chunk_checksum() && BlobHasher::checksum(response.chunk_data()) != response.chunk_checksum()) {
+                corrupt = true;
+                break;
+            }
+            position_ += response.chunk_data().size();
+            const auto checksum = response.has_chunk_checksum() ? std::optional(response.chunk_checksum()) : std::nullopt;
+            if (auto consumed = consume(*response.mutable_chunk_data(), checksum); !consumed.has_value()) {
+                attempt->cancel();
+                return consumed;
+            }
+        } while (attempt->read(response));
+
+        if (corrupt) {
+            attempt->cancel();
+            Logger::warn("Replica ", attempt->address, " sent a corrupt chunk at byte ", position_, " of blob ", blob_hash_);
+            continue;
+        }
+        const auto status = attempt->reader->Finish();
+        if (status.ok()) {
+            return std::monostate{};
+        }
+        if (attempt->stalled) {
+            Logger::warn("Replica ", attempt->address, " sent nothing for ", idle_timeout_.count(), " ms at byte ",
+                         position_, " of blob ", blob_hash_);
+        } else {
+            Logger::warn("Replica ", attempt->address, " failed at byte ", position_, " of blob ", blob_hash_,
+                         ": ", status.error_message());
+        }
+    }
+}
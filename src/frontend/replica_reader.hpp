@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "services/worker_service.grpc.pb.h"
+#include "expected.hpp"
+
+/// Reads a blob (or its byte range) from any of its replicas.
+/// - hedging: if a replica doesn't send the first chunk within hedge_delay,
+///   the next replica is asked too and the first one to answer wins,
+/// - failover: if the replica fails mid-stream, or sends no chunk within idle_timeout (a stuck disk,
+///   a dead host), the read resumes on the next replica at the current offset, so the consumer
+///   sees one continuous stream.
+/// - chunks come with their checksums (when the worker sends them), a chunk that doesn't match
+///   counts as a failure of the replica.
+/// Example usage:
+///   ReplicaReader reader(blob_hash, replicas, offset, length, hedge_delay, idle_timeout);
+///   reader.read([&](std::string& chunk, std::optional<uint64_t> checksum) -> Expected<std::monostate, std::string> { ... });
+class ReplicaReader {
+public:
+    using ChunkConsumer = std::function<Expected<std::monostate, std::string>(std::string& chunk,
+                                                                             std::optional<uint64_t> checksum)>;
+
+    ReplicaReader(std::string blob_hash, std::vector<std::string> replicas, uint64_t offset,
+                  std::optional<uint64_t> length, std::chrono::milliseconds hedge_delay,
+                  std::chrono::milliseconds idle_timeout);
+
+    /// Passes the chunks to the consumer in order. Stops on the first consumer error.
+    auto read(const ChunkConsumer& consume) -> Expected<std::monostate, std::string>;
+
+private:
+    /// One GetBlob stream. Its first Read runs in a separate thread, so several replicas can race.
+    /// A watchdog thread cancels the stream when a Read waits longer than the idle timeout.
+    struct Attempt {
+        std::string address;
+        grpc::ClientContext context;
+        std::unique_ptr<worker::WorkerService::Stub> stub;
+        std::unique_ptr<grpc::ClientReader<worker::GetBlobResponse>> reader;
+        worker::GetBlobResponse first_chunk;
+        bool got_first_chunk = false;
+        bool first_read_done = false; // guarded by ReplicaReader::mutex_
+        std::thread first_read;
+
+        std::mutex watchdog_mutex;
+        std::condition_variable watchdog_wakeup;
+        std::optional<std::chrono::steady_clock::time_point> read_deadline; // while a Read waits
+        bool watchdog_stopped = false;
+        std::atomic<bool> stalled = false;
+        std::thread watchdog;
+
+        explicit Attempt(std::chrono::milliseconds idle_timeout);
+        ~Attempt();
+        /// Opens the stream and reads the first chunk, or fails if none comes within the idle timeout.
+        bool open(const worker::GetBlobRequest& request);
+        /// Reads the next chunk, or fails if none comes within the idle timeout.
+        bool read(worker::GetBlobResponse& response);
+        /// Stops the stream, ignoring its result.
+        void cancel();
+
+    private:
+        std::chrono::milliseconds idle_timeout_;
+
+        void set_read_deadline(std::optional<std::chrono::steady_clock::time_point> deadline);
+    };
+
+    std::string blob_hash_;
+    std::vector<std::string> replicas_;
+    size_t next_replica_ = 0;
+    uint64_t position_;
+    std::optional<uint64_t> end_;
+    std::chrono::milliseconds hedge_delay_;
+    std::chrono::milliseconds idle_timeout_;
+
+    std::mutex mutex_;
+    std::condition_variable first_read_done_;
+
+    auto start_attempt() -> std::shared_ptr<Attempt>;
+    /// Opens a stream at position_ on the replica that answers first.
+    auto open_stream() -> Expected<std::shared_ptr<Attempt>, std::string>;
+};
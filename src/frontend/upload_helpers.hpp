@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "services/worker_service.pb.h"
+
+/// Blob size as requested from the master (rounded up to whole MB).
+inline uint64_t size_in_mb(const uint64_t size_bytes) {
+    constexpr uint64_t MB = 1024 * 1024;
+    return (size_bytes + MB - 1) / MB;
+}
+
+/// Chunks a call may buffer, charged against the admission memory quota: the upload window of
+/// a pipelined upload (a spooled one keeps the blob on disk), a chunk from each of two hedged replicas.
+constexpr uint64_t PIPELINED_UPLOAD_BUFFER_BYTES = (BlobStoreConfig::UPLOAD_WINDOW_CHUNKS + 1) * BlobStoreConfig::MAX_CHUNK_SIZE;
+constexpr uint64_t SPOOLED_UPLOAD_BUFFER_BYTES = BlobStoreConfig::MAX_CHUNK_SIZE;
+constexpr uint64_t DOWNLOAD_BUFFER_BYTES = 2 * BlobStoreConfig::MAX_CHUNK_SIZE;
+
+/// Temporary key of a pipelined upload, until its hash is known.
+inline std::string new_upload_id() {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+    return "upload-" + std::to_string(generator());
+}
+
+/// Where the frontend sends an upload: to every worker (fan-out), or only to the head
+/// of the chain, which forwards it along the rest of the chain.
+struct UploadTargets {
+    std::vector<std::string> workers;
+    std::vector<std::string> chain;
+};
+
+inline UploadTargets upload_targets(const std::vector<std::string>& workers, const bool chain_replication) {
+    if (!chain_replication || workers.empty()) {
+        return {workers, {}};
+    }
+    return {{workers.front()}, {workers.begin() + 1, workers.end()}};
+}
+
+/// The first SaveBlobRequest of an upload, with the fields that are sent only once.
+inline worker::SaveBlobRequest first_save_blob_request(const std::string& blob_hash,
+                                                       const std::vector<std::string>& chain,
+                                                       const uint64_t blob_size) {
+    worker::SaveBlobRequest request;
+    request.set_blob_hash(blob_hash);
+    request.mutable_chain()->Assign(chain.begin(), chain.end());
+    request.set_blob_size(blob_size);
+    return request;
+}
+
+/// Turns the first SaveBlobRequest into the template of the next ones.
+inline void clear_first_message_fields(worker::SaveBlobRequest& request) {
+    request.clear_chain();
+    request.clear_blob_size();
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// In-memory cache of the workers with a saved copy of a blob, keyed by the blob hash, so GetWorkerWithBlob
+/// of a hot blob doesn't query the database. Bounded by the number of entries, the least recently used
+/// one is evicted first.
+/// - The changes made through this master erase the entries right away. NotifyBlobSaved and ReportCorruptBlob
+///   of a worker go to the worker's master, which needn't be the one that serves the blob, so entries
+///   also expire after ttl.
+/// - For the same reason only complete locations are cached: a blob that isn't stored (yet) or has
+///   fewer than min_workers saved copies (e.g. while an upload is still saving the rest) isn't, it would
+///   hide the copies saved in the meantime.
+/// Example usage:
+///   if (auto workers = cache.get(hash)) { ... }
+///   const auto generation = cache.generation();
+///   ...query the database...
+///   cache.put(hash, workers, generation);
+class BlobLocationCache {
+public:
+    struct Options {
+        size_t max_entries = 100000;
+        std::chrono::milliseconds ttl = std::chrono::seconds(30);
+        size_t min_workers = 1;
+    };
+
+private:
+    struct Item {
+        std::string hash;
+        std::vector<std::string> workers;
+        std::chrono::steady_clock::time_point expires_at;
+    };
+    using List = std::list<Item>;
+
+    const Options options_;
+    mutable std::mutex mutex_;
+    List items_; // most recently used at the front
+    std::unordered_map<std::string, List::iterator> index_;
+    uint64_t erase_count_ = 0;
+
+    void erase_locked(const std::unordered_map<std::string, List::iterator>::iterator found)
+    {
+        items_.erase(found->second);
+        index_.erase(found);
+    }
+
+public:
+    explicit BlobLocationCache(const Options options) : options_(options) {}
+
+    /// The workers with the blob, or nullopt if it isn't cached.
+    std::optional<std::vector<std::string>> get(const std::string& hash)
+    {
+        std::lock_guard lock(mutex_);
+        const auto found = index_.find(hash);
+        if (found == index_.end()) {
+            return std::nullopt;
+        }
+        if (found->second->expires_at <= std::chrono::steady_clock::now()) {
+            erase_locked(found);
+            return std::nullopt;
+        }
+        items_.splice(items_.begin(), items_, found->second);
+        return found->second->workers;
+    }
+
+    /// Changes whenever an entry is erased. Read it before querying the database and pass to put(),
+    /// so a location that changed in the meantime doesn't get back into the cache.
+    [[nodiscard]] uint64_t generation() const
+    {
+        std::lock_guard lock(mutex_);
+        return erase_count_;
+    }
+
+    /// Ignored if there are fewer than min_workers workers.
+    void put(const std::string& hash, std::vector<std::string> workers, const uint64_t generation)
+    {
+        if (workers.empty() || workers.size() < options_.min_workers) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        if (generation != erase_count_ || options_.max_entries == 0) {
+            return;
+        }
+        if (const auto found = index_.find(hash); found != index_.end()) {
+            erase_locked(found);
+        }
+        items_.push_front({hash, std::move(workers), std::chrono::steady_clock::now() + options_.ttl});
+        index_[hash] = items_.begin();
+        while (items_.size() > options_.max_entries) {
+            index_.erase(items_.back().hash);
+            items_.pop_back();
+        }
+    }
+
+    void erase(const std::string& hash)
+    {
+        std::lock_guard lock(mutex_);
+        erase_count_++;
+        if (const auto found = index_.find(hash); found != index_.end()) {
+            erase_locked(found);
+        }
+    }
+
+    /// Erases the blobs with a copy on the worker, e.g. when it registers again and its lost copies are dropped.
+    void erase_worker(const std::string& worker_address)
+    {
+        std::lock_guard lock(mutex_);
+        erase_count_++;
+        std::erase_if(items_, [&](const Item& item) {
+            const bool has_copy = std::ranges::find(item.workers, worker_address) != item.workers.end();
+            if (has_copy) {
+                index_.erase(item.hash);
+            }
+            return has_copy;
+        });
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        std::lock_guard lock(mutex_);
+        return items_.size();
+    }
+};
@@ -4,6 +4,7 @@
 #include <google/cloud/spanner/client.h>
 #include <google/cloud/spanner/mutations.h>
 #include <iostream>
+#include <optional>
 #include <vector>
 #include <master_db_repository.hpp>
 #include <sys/stat.h>
@@ -68,6 +69,33 @@ auto MasterDbRepository::updateBlobEntry(const BlobCopyDTO& entry) -> Expected<s
     return std::monostate();
 }
 
+// Moves the blob copy of entry.worker_address stored under old_hash to entry.hash, in one transaction.
+auto MasterDbRepository::replaceBlobEntry(const std::string& old_hash, const BlobCopyDTO& entry)
+    -> Expected<std::monostate, grpc::Status>
+{
+    Logger::debug("MasterDbRepository::replaceBlobEntry ", old_hash, " -> ", entry.to_string());
+    std::string sql = "DELETE FROM blob_copy WHERE hash = $1 AND worker_address = $2";
+    auto statement = spanner::SqlStatement(sql, {{"p1", spanner::Value(old_hash)},
+                                                 {"p2", spanner::Value(entry.worker_address)}});
+    auto mutation = spanner::InsertOrUpdateMutationBuilder(
+        "blob_copy",
+        {"hash", "worker_address", "state", "size_mb"})
+        .EmplaceRow(entry.hash, entry.worker_address, entry.state, entry.size_mb)
+        .Build();
+
+    auto commit_result = client->Commit([statement, mutation, this](spanner::Transaction txn)
+        -> google::cloud::StatusOr<spanner::Mutations> {
+            auto dele = client->ExecuteDml(std::move(txn), statement);
+            if (!dele) return std::move(dele).status();
+            return spanner::Mutations{mutation};
+    });
+
+    if (!commit_result) {
+        return to_grpc_status(commit_result.status());
+    }
+    return std::monostate();
+}
+
     // Method to query entries by hash
 auto MasterDbRepository::querySavedBlobByHash(const std::string& hash) -> Expected<std::vector<BlobCopyDTO>, grpc::Status>{
     Logger::debug("MasterDbRepository::querySavedBlobByHash ", hash);
@@ -163,6 +191,53 @@ auto MasterDbRepository::deleteBlobEntriesByWorkerAddress(const std::string& wor
     return std::monostate();
 }
 
+auto MasterDbRepository::queryBlobsByWorkerAddress(const std::string& worker_address) -> Expected<std::vector<BlobCopyDTO>,
+    grpc::Status>
+{
+    Logger::debug("MasterDbRepository::queryBlobsByWorkerAddress ", worker_address);
+    std::vector<BlobCopyDTO> results;
+    auto query = spanner::SqlStatement(
+        "SELECT hash, worker_address, state, size_mb FROM blob_copy "
+        "WHERE worker_address = $1",
+        {{"p1", spanner::Value(worker_address)}});
+
+    auto rows = client->ExecuteQuery(query);
+
+    using rowType = std::tuple<std::string, std::string, std::string, int64_t>;
+    for (auto const& row : spanner::StreamOf<rowType>(rows)) {
+        if (!row) {
+            return to_grpc_status(row.status());
+        }
+        results.emplace_back(std::get<0>(*row), std::get<1>(*row), std::get<2>(*row), std::get<3>(*row));
+    }
+
+    return results;
+}
+
+// Deletes the blob copies of one worker with the given hashes, in one transaction.
+auto MasterDbRepository::deleteBlobEntries(const std::string& worker_address, const std::vector<std::string>& hashes)
+    -> Expected<std::monostate, grpc::Status>
+{
+    Logger::debug("MasterDbRepository::deleteBlobEntries ", worker_address, " ", hashes.size(), " entries");
+    if (hashes.empty()) {
+        return std::monostate();
+    }
+    std::string sql = "DELETE FROM blob_copy WHERE worker_address = $1 AND hash IN UNNEST($2)";
+    auto statement = spanner::SqlStatement(sql, {{"p1", spanner::Value(worker_address)},
+                                                 {"p2", spanner::Value(hashes)}});
+
+    auto commit_result = client->Commit([statement, this](spanner::Transaction txn)
+        -> google::cloud::StatusOr<spanner::Mutations> {
+            auto dele = client->ExecuteDml(std::move(txn), statement);
+            if (!dele) return std::move(dele).status();
+            return spanner::Mutations{};
+    });
+
+    if (!commit_result) {
+        return to_grpc_status(commit_result.status());
+    }
+    return std::monostate();
+}
 
 auto MasterDbRepository::addWorkerState(const WorkerStateDTO& worker_state) -> Expected<std::monostate, grpc::Status>
 {
@@ -197,6 +272,26 @@ auto MasterDbRepository::updateWorkerState(const WorkerStateDTO& worker_state) -
     return std::monostate();
 }
 
+auto MasterDbRepository::recordHeartbeat(const std::string& worker_address, const int64_t available_space_mb,
+                                         const int64_t epoch_ts) -> Expected<std::monostate, grpc::Status>
+{
+    Logger::debug("MasterDbRepository::recordHeartbeat ", worker_address, " ", available_space_mb, " ", epoch_ts);
+    // locked_space_mb isn't written, so a heartbeat doesn't undo a placement committed in the meantime.
+    auto mutation = spanner::UpdateMutationBuilder(
+        "worker_state", {"worker_address", "available_space_mb", "last_heartbeat_epoch_ts"})
+    .EmplaceRow(worker_address, available_space_mb, epoch_ts).Build();
+
+    auto commit_result = client->Commit(spanner::Mutations{mutation});
+
+    if (!commit_result) {
+        if (commit_result.status().code() == google::cloud::StatusCode::kNotFound) {
+            return grpc::Status(grpc::NOT_FOUND, "Worker " + worker_address + " isn't registered");
+        }
+        return to_grpc_status(commit_result.status());
+    }
+    return std::monostate();
+}
+
 auto MasterDbRepository::deleteWorkerState(const std::string& worker_address) -> Expected<std::monostate, grpc::Status>
 {
     Logger::debug("MasterDbRepository::deleteWorkerState ", worker_address);
@@ -271,4 +366,117 @@ auto MasterDbRepository::getWorkersWithFreeSpace(int64_t spaceNeeded, int32_t nu
     }
 
     return result;
-}
\ No newline at end of file
+}
+
+auto MasterDbRepository::getWorkerStates() -> Expected<std::vector<WorkerStateDTO>, grpc::Status> {
+    Logger::debug("MasterDbRepository::getWorkerStates");
+    auto query = spanner::SqlStatement(
+        "SELECT worker_address, available_space_mb, locked_space_mb, last_heartbeat_epoch_ts "
+        "FROM worker_state");
+
+    auto rows = client->ExecuteQuery(query);
+    std::vector<WorkerStateDTO> result;
+    for (auto const& row : spanner::StreamOf<std::tuple<std::string, int64_t, int64_t, int64_t>>(rows)) {
+        if (!row) {
+            return to_grpc_status(row.status());
+        }
+        result.emplace_back(std::get<0>(*row), std::get<1>(*row), std::get<2>(*row), std::get<3>(*row));
+    }
+    return result;
+}
+
+// Adds the deltas to the worker's available and locked space in a read-write transaction, which writes
+// only these two columns: a placement or a heartbeat committed in the meantime isn't overwritten.
+// Returns the updated worker state, NOT_FOUND if the worker isn't registered.
+auto MasterDbRepository::adjustWorkerSpace(const std::string& worker_address, int64_t available_delta_mb,
+                                           int64_t locked_delta_mb) -> Expected<WorkerStateDTO, grpc::Status>
+{
+    constexpr int MAX_ABORTED_ATTEMPTS = 10;
+    Logger::debug("MasterDbRepository::adjustWorkerSpace ", worker_address, " ", available_delta_mb, " ", locked_delta_mb);
+    std::optional<WorkerStateDTO> updated;
+    auto commit_result = client->Commit([&](spanner::Transaction txn)
+        -> google::cloud::StatusOr<spanner::Mutations> {
+            updated.reset();
+            auto rows = client->Read(txn, "worker_state", spanner::KeySet().AddKey(spanner::MakeKey(worker_address)),
+                {"worker_address", "available_space_mb", "locked_space_mb", "last_heartbeat_epoch_ts"});
+            for (auto const& row : spanner::StreamOf<std::tuple<std::string, int64_t, int64_t, int64_t>>(rows)) {
+                if (!row) return row.status();
+                updated.emplace(std::get<0>(*row), std::get<1>(*row) + available_delta_mb,
+                                std::get<2>(*row) + locked_delta_mb, std::get<3>(*row));
+            }
+            if (!updated) {
+                return google::cloud::Status(google::cloud::StatusCode::kNotFound,
+                    "Worker " + worker_address + " isn't registered");
+            }
+            return spanner::Mutations{spanner::UpdateMutationBuilder(
+                "worker_state", {"worker_address", "available_space_mb", "locked_space_mb"})
+                .EmplaceRow(worker_address, updated->available_space_mb, updated->locked_space_mb).Build()};
+        },
+        spanner::LimitedErrorCountTransactionRerunPolicy(MAX_ABORTED_ATTEMPTS).clone(),
+        spanner::ExponentialBackoffPolicy(std::chrono::milliseconds(10), std::chrono::seconds(1), 2.0).clone());
+
+    if (!commit_result) {
+        if (commit_result.status().code() == google::cloud::StatusCode::kNotFound) {
+            return grpc::Status(grpc::NOT_FOUND, commit_result.status().message());
+        }
+        return to_grpc_status(commit_result.status());
+    }
+    return *updated;
+}
+
+// Adds a blob copy during creation on each of the workers and locks size_mb of their space, in one
+// read-write transaction. The workers are picked by the caller, the transaction reads their rows by key
+// (which also locks them) and fails with FAILED_PRECONDITION if one of them doesn't have the space anymore.
+// A transaction aborted by a conflicting one is run again. Returns the updated worker states.
+auto MasterDbRepository::placeBlob(const std::string& hash, int64_t size_mb, const std::vector<std::string>& workers)
+    -> Expected<std::vector<WorkerStateDTO>, grpc::Status>
+{
+    constexpr int MAX_ABORTED_ATTEMPTS = 10;
+    Logger::debug("MasterDbRepository::placeBlob ", hash, " ", size_mb, " ", workers.size(), " workers");
+    auto keys = spanner::KeySet();
+    for (const auto& worker_address : workers) {
+        keys.AddKey(spanner::MakeKey(worker_address));
+    }
+
+    std::vector<WorkerStateDTO> updated;
+    auto commit_result = client->Commit([&](spanner::Transaction txn)
+        -> google::cloud::StatusOr<spanner::Mutations> {
+            updated.clear();
+            auto blob_copies = spanner::InsertMutationBuilder(
+                "blob_copy",
+                {"hash", "worker_address", "state", "size_mb"});
+            auto locks = spanner::UpdateMutationBuilder(
+                "worker_state",
+                {"worker_address", "locked_space_mb"});
+
+            auto rows = client->Read(txn, "worker_state", keys,
+                {"worker_address", "available_space_mb", "locked_space_mb", "last_heartbeat_epoch_ts"});
+            for (auto const& row : spanner::StreamOf<std::tuple<std::string, int64_t, int64_t, int64_t>>(rows)) {
+                if (!row) return row.status();
+                auto worker = WorkerStateDTO(std::get<0>(*row), std::get<1>(*row), std::get<2>(*row), std::get<3>(*row));
+                if (worker.available_space_mb - worker.locked_space_mb < size_mb) {
+                    return google::cloud::Status(google::cloud::StatusCode::kFailedPrecondition,
+                        "Worker " + worker.worker_address + " doesn't have " + std::to_string(size_mb) + " MB anymore");
+                }
+                worker.locked_space_mb += size_mb;
+                blob_copies.EmplaceRow(hash, worker.worker_address, BLOB_STATUS_DURING_CREATION, size_mb);
+                locks.EmplaceRow(worker.worker_address, worker.locked_space_mb);
+                updated.push_back(std::move(worker));
+            }
+            if (updated.size() < workers.size()) {
+                return google::cloud::Status(google::cloud::StatusCode::kFailedPrecondition,
+                    "Some of the picked workers are gone");
+            }
+            return spanner::Mutations{std::move(blob_copies).Build(), std::move(locks).Build()};
+        },
+        spanner::LimitedErrorCountTransactionRerunPolicy(MAX_ABORTED_ATTEMPTS).clone(),
+        spanner::ExponentialBackoffPolicy(std::chrono::milliseconds(10), std::chrono::seconds(1), 2.0).clone());
+
+    if (!commit_result) {
+        if (commit_result.status().code() == google::cloud::StatusCode::kFailedPrecondition) {
+            return grpc::Status(grpc::FAILED_PRECONDITION, commit_result.status().message());
+        }
+        return to_grpc_status(commit_result.status());
+    }
+    return updated;
+}
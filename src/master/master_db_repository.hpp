@@ -14,6 +14,7 @@
 
 #define BLOB_STATUS_DURING_CREATION "DURING_CREATION"
 #define BLOB_STATUS_SAVED "SAVED"
+#define BLOB_STATUS_CORRUPT "CORRUPT"
 
 namespace spanner = ::google::cloud::spanner;
 
@@ -68,15 +69,23 @@ public:
     // Database operations
     auto addBlobEntry(const BlobCopyDTO& entry) -> Expected<std::monostate, grpc::Status>;
     auto updateBlobEntry(const BlobCopyDTO& entry) -> Expected<std::monostate, grpc::Status>;
+    auto replaceBlobEntry(const std::string& old_hash, const BlobCopyDTO& entry) -> Expected<std::monostate, grpc::Status>;
     auto querySavedBlobByHash(const std::string& hash) -> Expected<std::vector<BlobCopyDTO>, grpc::Status>;
     auto queryBlobByHashAndWorkerId(const std::string& hash, const std::string& worker_address) -> Expected<std::vector<BlobCopyDTO>, grpc:: Status>;
     auto deleteBlobEntryByHash(const std::string& hash) -> Expected<std::monostate, grpc::Status>;
     auto deleteBlobEntriesByWorkerAddress(const std::string& worker_address) -> Expected<std::monostate, grpc::Status>;
+    auto queryBlobsByWorkerAddress(const std::string& worker_address) -> Expected<std::vector<BlobCopyDTO>, grpc::Status>;
+    auto deleteBlobEntries(const std::string& worker_address, const std::vector<std::string>& hashes) -> Expected<std::monostate, grpc::Status>;
     auto addWorkerState(const WorkerStateDTO& worker_state) -> Expected<std::monostate, grpc::Status>;
     auto updateWorkerState(const WorkerStateDTO& worker_state) -> Expected<std::monostate, grpc::Status>;
+    /// Writes the free space and the heartbeat time only, NOT_FOUND if the worker isn't registered.
+    auto recordHeartbeat(const std::string& worker_address, int64_t available_space_mb, int64_t epoch_ts) -> Expected<std::monostate, grpc::Status>;
     auto deleteWorkerState(const std::string& worker_address) -> Expected<std::monostate, grpc::Status>;
     auto getWorkerState(const std::string& worker_address) -> Expected<WorkerStateDTO, grpc::Status>;
     auto getWorkersWithFreeSpace(int64_t spaceNeeded, int32_t num_workers) -> Expected<std::vector<WorkerStateDTO>, grpc::Status>;
+    auto getWorkerStates() -> Expected<std::vector<WorkerStateDTO>, grpc::Status>;
+    auto adjustWorkerSpace(const std::string& worker_address, int64_t available_delta_mb, int64_t locked_delta_mb) -> Expected<WorkerStateDTO, grpc::Status>;
+    auto placeBlob(const std::string& hash, int64_t size_mb, const std::vector<std::string>& workers) -> Expected<std::vector<WorkerStateDTO>, grpc::Status>;
 
 private:
     std::shared_ptr<spanner::Client> client;
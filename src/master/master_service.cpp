@@ -11,6 +11,10 @@
 
 #include <services/worker_service.grpc.pb.h>
 
+#include <unordered_set>
+
+#include "channel_pool.hpp"
+#include "config.hpp"
 #include "logging.hpp"
 
 namespace master
@@ -18,8 +22,59 @@ namespace master
     class GetWorkersToSaveBlobRequest;
 }
 
+int64_t epoch_seconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/// Workers with an older heartbeat are taken for dead.
+int64_t alive_since()
+{
+    return epoch_seconds() - std::chrono::seconds(BlobStoreConfig::HEARTBEAT_TIMEOUT).count();
+}
+
+int64_t bytes_to_mb(const uint64_t bytes)
+{
+    return static_cast<int64_t>(bytes >> 20);
+}
+
 MasterServiceImpl::MasterServiceImpl(MasterDbRepository *db) {
-   this->db = db;
+    this->db = db;
+    refresh_workers();
+    refresher_ = std::jthread([this](const std::stop_token& stop) {
+        while (true) {
+            {
+                std::unique_lock lock(refresh_mutex_);
+                refresh_wakeup_.wait_for(lock, stop, WORKER_TABLE_REFRESH_INTERVAL, [] { return false; });
+            }
+            if (stop.stop_requested()) {
+                return;
+            }
+            refresh_workers();
+        }
+    });
+}
+
+void MasterServiceImpl::refresh_workers()
+{
+    auto workers = db->getWorkerStates();
+    if (!workers.has_value()) {
+        Logger::warn("Couldn't refresh the worker table: ", workers.error().error_message());
+        return;
+    }
+    workers_.replace_all(workers.value());
+}
+
+auto MasterServiceImpl::adjust_worker_space(const std::string& worker_address, const int64_t available_delta_mb,
+                                            const int64_t locked_delta_mb) -> Expected<std::monostate, grpc::Status>
+{
+    auto updated = db->adjustWorkerSpace(worker_address, available_delta_mb, locked_delta_mb);
+    if (!updated.has_value()) {
+        return updated.error();
+    }
+    workers_.put(updated.value());
+    return std::monostate{};
 }
 grpc::Status MasterServiceImpl::GetWorkersToSaveBlob(
     grpc::ServerContext* context,
@@ -30,32 +85,33 @@ grpc::Status MasterServiceImpl::GetWorkersToSaveBlob(
     auto blob_size_mb = static_cast<int64_t>(request->size_mb());
     Logger::info("Blob size ", blob_size_mb);
 
-    return db->getWorkersWithFreeSpace(blob_size_mb, 3)
-    .and_then([&](auto workers) -> Expected<std::monostate, grpc::Status> {
-        Logger::info("Found workers with enough free space ", workers[0].worker_address, " ", workers[1].worker_address, " ", workers[2].worker_address);
-        for (const auto& worker : workers)
-        {
-            // Add to response
-            std::string* workerAddress = response->add_addresses();
-            *workerAddress = worker.worker_address;
-
-            // Add blob copy to database with state "during creation"
-            const auto dto = BlobCopyDTO(request->blob_hash(), worker.worker_address, BLOB_STATUS_DURING_CREATION, blob_size_mb);
-            auto result = db->addBlobEntry(dto);
-            if (not result.has_value()) return result;
-
-            // Update worker state to mark locked space
-            auto worker_state_dto = WorkerStateDTO(worker.worker_address,worker.available_space_mb,
-                                                         blob_size_mb + worker.locked_space_mb,
-                                                         worker.last_heartbeat_epoch_ts);
-            result = db->updateWorkerState(worker_state_dto);
-            if (not result.has_value()) return result;
-        }
-        return std::monostate();
-    })
-    .output<grpc::Status>(
-        [](auto _) { return grpc::Status::OK; },
-        [](auto err) { Logger::error(err.error_message()); return err; });
+    // The workers are picked from the worker table, one transaction checks them and saves the blob
+    // copies and the locked space of all replicas. The table may miss the placements of the other
+    // masters, then it's refreshed and the workers are picked again.
+    constexpr int MAX_PLACEMENT_ATTEMPTS = 3;
+    for (int attempt = 1;; attempt++) {
+        const auto workers = workers_.pick(blob_size_mb, BlobStoreConfig::REPLICATION_FACTOR, alive_since());
+        auto placed = workers.size() < BlobStoreConfig::REPLICATION_FACTOR
+            ? grpc::Status(grpc::RESOURCE_EXHAUSTED, "Requested " + std::to_string(BlobStoreConfig::REPLICATION_FACTOR)
+                           + " workers, but only " + std::to_string(workers.size()) + " are alive with enough free space")
+            : db->placeBlob(request->blob_hash(), blob_size_mb, workers);
+        if (placed.has_value()) {
+            for (const auto& worker : placed.value()) {
+                workers_.put(worker);
+            }
+            for (const auto& worker_address : workers) {
+                response->add_addresses(worker_address);
+            }
+            return grpc::Status::OK;
+        }
+        const auto code = placed.error().error_code();
+        if (attempt == MAX_PLACEMENT_ATTEMPTS || (code != grpc::FAILED_PRECONDITION && code != grpc::RESOURCE_EXHAUSTED)) {
+            Logger::error(placed.error().error_message());
+            return placed.error();
+        }
+        Logger::info("Placement failed (", placed.error().error_message(), "), refreshing the worker table");
+        refresh_workers();
+    }
 }
 
 grpc::Status MasterServiceImpl::GetWorkerWithBlob(
@@ -65,72 +121,245 @@ grpc::Status MasterServiceImpl::GetWorkerWithBlob(
     std::string blob_hash = request->blob_hash();
     Logger::info("GetWorkerWithBlob with hash ", blob_hash);
 
-    return db->querySavedBlobByHash(request->blob_hash())
-    .and_then([&](auto blob_copies) -> Expected<BlobCopyDTO, grpc::Status> {
-        if (blob_copies.empty()) {
+    const auto reply = [&](std::vector<std::string> workers) {
+        if (workers.empty()) {
             return grpc::Status(grpc::CANCELLED, "Error: Blob with requested hash doesn't exist");
         }
-        // choose one of the copies
-        BlobCopyDTO &blob_copy = blob_copies[0];
-        Logger::info("Blob found on ", blob_copies.size(), " workers, choosing ", blob_copy.worker_address);
-        return blob_copy;
-    })
-    .and_then([&](auto blob_copy) -> Expected<WorkerStateDTO, grpc::Status> {
-        return db->getWorkerState(blob_copy.worker_address);
-    }).output<grpc::Status>([&](auto worker_state){
-        response->set_addresses(worker_state.worker_address);
+        // The workers without a recent heartbeat are left out, unless no other worker has the blob:
+        // then trying them is all the frontend can do.
+        const auto since = alive_since();
+        if (!std::ranges::all_of(workers, [&](const auto& worker) { return workers_.is_stale(worker, since); })) {
+            std::erase_if(workers, [&](const auto& worker) { return workers_.is_stale(worker, since); });
+        }
+        // The frontend reads the copies in this order (the next ones are its fallback and hedge), so the
+        // reads of a hot blob spread over its copies by the load of the workers.
+        workers = workers_.order_for_read(std::move(workers));
+        Logger::info("Blob found on ", workers.size(), " workers");
+        response->set_addresses(workers[0]);
+        for (const auto& worker_address : workers) {
+            response->add_replicas(worker_address);
+        }
         return grpc::Status::OK;
+    };
+    if (const auto cached = locations_.get(blob_hash)) {
+        return reply(*cached);
+    }
+
+    const auto generation = locations_.generation();
+    return db->querySavedBlobByHash(blob_hash)
+    .output<grpc::Status>([&](auto blob_copies) {
+        std::vector<std::string> workers;
+        for (const auto& blob_copy : blob_copies) {
+            workers.push_back(blob_copy.worker_address);
+        }
+        locations_.put(blob_hash, workers, generation);
+        return reply(workers);
     }, [](auto err) { Logger::error(err.error_message()); return err; });
 }
 
-
 grpc::Status MasterServiceImpl::NotifyBlobSaved(
     grpc::ServerContext* context,
     const master::NotifyBlobSavedRequest* request,
     master::NotifyBlobSavedResponse* response)
 {
     Logger::info("NotifyBlobSaved ", request->blob_hash(), " ", request->worker_address());
-    return db->queryBlobByHashAndWorkerId(request->blob_hash(), request->worker_address())
+    // Pipelined uploads are placed under a temporary upload id, before the hash is known.
+    const auto& placement_hash = request->has_upload_id() ? request->upload_id() : request->blob_hash();
+    const auto status = db->queryBlobByHashAndWorkerId(placement_hash, request->worker_address())
     .and_then([&](auto blob_dtos) -> Expected<BlobCopyDTO, grpc::Status> {
         if (blob_dtos.size() != 1) {
             return grpc::Status(grpc::CANCELLED, "Wrong query result");
         }
         auto blob = blob_dtos[0];
+        blob.hash = request->blob_hash();
         blob.state = BLOB_STATUS_SAVED;
         return blob;
     })
     .and_then([&](auto blob) -> Expected<std::monostate, grpc::Status> {
-        auto update_blob_result = db->updateBlobEntry(blob);
+        auto update_blob_result = request->has_upload_id()
+            ? db->replaceBlobEntry(request->upload_id(), blob)
+            : db->updateBlobEntry(blob);
         if (not update_blob_result.has_value()) return update_blob_result;
-        auto result = db->getWorkerState(request->worker_address());
-        if (not result.has_value()) return result.error();
-        auto worker_state = result.value();
-        worker_state.locked_space_mb -= blob.size_mb;
-        worker_state.available_space_mb -= blob.size_mb;
-        return db->updateWorkerState(worker_state);
+        // A compressed blob takes less than it had locked.
+        const auto stored_size_mb = request->has_stored_size_bytes()
+            ? static_cast<int64_t>((request->stored_size_bytes() + (1 << 20) - 1) >> 20)
+            : blob.size_mb;
+        return adjust_worker_space(request->worker_address(), -stored_size_mb, -blob.size_mb);
     }).output<grpc::Status>([&](auto _){ return grpc::Status::OK; },
         [](auto err) { Logger::error(err.error_message()); return err; });
+    // After the write, so a lookup that read the old copies in the meantime can't cache them.
+    locations_.erase(request->blob_hash());
+    return status;
 }
 
-grpc::Status MasterServiceImpl::RegisterWorker(grpc::ServerContext* context, const master::RegisterWorkerRequest* request, master::RegisterWorkerResponse* response)
+grpc::Status MasterServiceImpl::RegisterWorker(grpc::ServerContext* context,
+                                               grpc::ServerReader<master::RegisterWorkerRequest>* reader,
+                                               master::RegisterWorkerResponse* response)
 {
     Logger::info("RegisterWorker");
-    // If there was a worker with the same address before then delete it (it must have been restarted)
-    return db->deleteWorkerState(request->address())
+    master::RegisterWorkerRequest request;
+    if (!reader->Read(&request)) {
+        return grpc::Status(grpc::INVALID_ARGUMENT, "Empty RegisterWorker stream.");
+    }
+    const auto address = request.address();
+    const auto space_available = request.space_available();
+    if (request.state_only()) {
+        return recreate_worker_state(address, space_available);
+    }
+    std::unordered_set<std::string> inventory;
+    std::unordered_set<std::string> aborted_uploads;
+    do {
+        for (const auto& blob : request.blobs()) {
+            inventory.insert(blob.hash());
+        }
+        aborted_uploads.insert(request.aborted_uploads().begin(), request.aborted_uploads().end());
+    } while (reader->Read(&request));
+    Logger::info("Worker ", address, " has ", inventory.size(), " blobs, ", aborted_uploads.size(), " aborted uploads");
+
+    // A restarted worker keeps its blobs: the copies it still has stay, the rest are dropped.
+    const auto status = db->deleteWorkerState(address)
     .and_then([&](auto _) -> Expected<std::monostate, grpc::Status> {
-        return db->deleteBlobEntriesByWorkerAddress(request->address());
+        // Registration counts as the first heartbeat.
+        auto worker_state = WorkerStateDTO(address, bytes_to_mb(space_available), 0, epoch_seconds());
+        auto added = db->addWorkerState(worker_state);
+        if (added.has_value()) {
+            workers_.put(worker_state);
+        }
+        return added;
     })
-    .and_then([&](auto _) -> Expected<std::monostate, grpc::Status> {
-        auto worker_state = WorkerStateDTO(request->address(), request->space_available(), 0, 0);
-        return db->addWorkerState(worker_state);
+    .and_then([&](auto _) -> Expected<std::vector<BlobCopyDTO>, grpc::Status> {
+        return db->queryBlobsByWorkerAddress(address);
+    })
+    .and_then([&](auto blob_copies) -> Expected<std::monostate, grpc::Status> {
+        std::vector<std::string> lost_copies;
+        for (const auto& blob_copy : blob_copies) {
+            // Copies during creation belong to uploads that were cut off by the restart.
+            if (blob_copy.state == BLOB_STATUS_SAVED && inventory.erase(blob_copy.hash) > 0) {
+                continue;
+            }
+            if (aborted_uploads.contains(blob_copy.hash)) {
+                Logger::info("Upload ", blob_copy.hash, " to ", address, " was aborted by the restart");
+            }
+            lost_copies.push_back(blob_copy.hash);
+        }
+        Logger::info("Worker ", address, ": ", blob_copies.size() - lost_copies.size(), " copies kept, ",
+                     lost_copies.size(), " lost, ", inventory.size(), " stale");
+        for (const auto& hash : inventory) {
+            response->add_stale_blobs(hash);
+        }
+        return db->deleteBlobEntries(address, lost_copies);
     }).output<grpc::Status>([&](auto _){ return grpc::Status::OK; },
         [](auto err) { Logger::error(err.error_message()); return err; });
+    locations_.erase_worker(address);
+    return status;
+}
+
+grpc::Status MasterServiceImpl::recreate_worker_state(const std::string& address, const int64_t space_available)
+{
+    Logger::info("Recreating the state of running worker ", address);
+    // The copies not saved yet (uploads in flight, repairs) keep their space locked.
+    return db->queryBlobsByWorkerAddress(address)
+    .and_then([&](auto blob_copies) -> Expected<std::monostate, grpc::Status> {
+        int64_t locked_mb = 0;
+        for (const auto& blob_copy : blob_copies) {
+            if (blob_copy.state != BLOB_STATUS_SAVED) {
+                locked_mb += blob_copy.size_mb;
+            }
+        }
+        auto deleted = db->deleteWorkerState(address);
+        if (!deleted.has_value()) return deleted;
+        auto worker_state = WorkerStateDTO(address, bytes_to_mb(space_available), locked_mb, epoch_seconds());
+        auto added = db->addWorkerState(worker_state);
+        if (added.has_value()) {
+            workers_.put(worker_state);
+        }
+        return added;
+    }).output<grpc::Status>([&](auto _){ return grpc::Status::OK; },
+        [](auto err) { Logger::error(err.error_message()); return err; });
+}
+
+grpc::Status MasterServiceImpl::ReportCorruptBlob(grpc::ServerContext* context,
+                                                  const master::ReportCorruptBlobRequest* request,
+                                                  master::ReportCorruptBlobResponse* response)
+{
+    const auto& address = request->worker_address();
+    const auto& hash = request->blob_hash();
+    Logger::warn("Worker ", address, " has a corrupt copy of blob ", hash);
+    const auto status = db->queryBlobByHashAndWorkerId(hash, address)
+    .and_then([&](auto blob_copies) -> Expected<BlobCopyDTO, grpc::Status> {
+        if (blob_copies.size() != 1) {
+            return grpc::Status(grpc::NOT_FOUND, "No copy of blob " + hash + " on worker " + address);
+        }
+        return blob_copies[0];
+    })
+    .and_then([&](auto blob_copy) -> Expected<BlobCopyDTO, grpc::Status> {
+        if (request->repair_failed()) {
+            return blob_copy;
+        }
+        auto saved_copies = db->querySavedBlobByHash(hash);
+        if (!saved_copies.has_value()) return saved_copies.error();
+        for (const auto& saved_copy : saved_copies.value()) {
+            if (saved_copy.worker_address != address) {
+                response->add_repair_sources(saved_copy.worker_address);
+            }
+        }
+        return blob_copy;
+    })
+    .and_then([&](auto blob_copy) -> Expected<std::monostate, grpc::Status> {
+        if (request->repair_failed()) {
+            // The space locked for the repair is given back with the copy.
+            Logger::error("Worker ", address, " couldn't repair blob ", hash, ", its copy is dropped");
+            auto deleted = db->deleteBlobEntries(address, {hash});
+            if (!deleted.has_value()) return deleted;
+            const auto locked_mb = blob_copy.state == BLOB_STATUS_CORRUPT ? blob_copy.size_mb : 0;
+            return adjust_worker_space(address, 0, -locked_mb);
+        }
+        // The copy's space is given back, or locked for the repair until NotifyBlobSaved.
+        int64_t locked_delta_mb = 0;
+        if (response->repair_sources_size() == 0) {
+            Logger::error("No intact copy of blob ", hash, " is left");
+            auto deleted = db->deleteBlobEntries(address, {hash});
+            if (!deleted.has_value()) return deleted;
+        } else {
+            blob_copy.state = BLOB_STATUS_CORRUPT;
+            auto updated = db->updateBlobEntry(blob_copy);
+            if (!updated.has_value()) return updated;
+            locked_delta_mb = blob_copy.size_mb;
+        }
+        return adjust_worker_space(address, blob_copy.size_mb, locked_delta_mb);
+    }).output<grpc::Status>([&](auto _){ return grpc::Status::OK; },
+        [](auto err) { Logger::error(err.error_message()); return err; });
+    locations_.erase(hash);
+    return status;
+}
+
+grpc::Status MasterServiceImpl::Heartbeat(grpc::ServerContext* context, const master::HeartbeatRequest* request,
+                                          master::HeartbeatResponse* response)
+{
+    const auto& address = request->worker_address();
+    Logger::debug("Heartbeat ", address, ", ", request->streams_in_flight(), " streams in flight, ",
+                  request->io_latency_us(), " us I/O latency");
+    // The space reserved on the worker belongs to the blobs placed there and not saved yet, which are
+    // locked here already, so it counts as available.
+    const auto available_space_mb = bytes_to_mb(request->free_space_bytes() + request->reserved_space_bytes());
+    const auto epoch_ts = epoch_seconds();
+    workers_.record_load(address, request->streams_in_flight(), static_cast<double>(request->io_latency_us()));
+    if (request->load_only()) {
+        // The worker's own master writes the state, this one only sees the worker alive sooner than
+        // the next refresh would tell.
+        workers_.record_heartbeat(address, available_space_mb, epoch_ts);
+        return grpc::Status::OK;
+    }
+    return db->recordHeartbeat(address, available_space_mb, epoch_ts)
+    .output<grpc::Status>([&](auto _) {
+        workers_.record_heartbeat(address, available_space_mb, epoch_ts);
+        return grpc::Status::OK;
+    }, [](auto err) { Logger::error(err.error_message()); return err; });
 }
 
 Expected<std::monostate, grpc::Status> requestWorkerToDeleteBlob(std::string blob_hash, std::string worker_address)
 {
-    const auto worker_channel = grpc::CreateChannel(worker_address, grpc::InsecureChannelCredentials());
-    const auto worker_stub = worker::WorkerService::NewStub(worker_channel);
+    const auto worker_stub = ChannelPool::instance().stub<worker::WorkerService>(worker_address);
 
     worker::DeleteBlobRequest request;
     worker::DeleteBlobResponse response;
@@ -149,7 +378,7 @@ Expected<std::monostate, grpc::Status> requestWorkerToDeleteBlob(std::string blo
 grpc::Status MasterServiceImpl::DeleteBlob(grpc::ServerContext* context, const master::DeleteBlobRequest* request, master::DeleteBlobResponse* response)
 {
     Logger::info("DeleteBlob");
-    return db->querySavedBlobByHash(request->blob_hash())
+    const auto status = db->querySavedBlobByHash(request->blob_hash())
     .and_then([&](auto blob_copies) -> Expected<std::monostate, grpc::Status> {
           Logger::debug("Blob copies ", blob_copies.size());
         for (const auto& blob_copy : blob_copies)
@@ -162,5 +391,7 @@ grpc::Status MasterServiceImpl::DeleteBlob(grpc::ServerContext* context, const m
         return db->deleteBlobEntryByHash(request->blob_hash());
     }).output<grpc::Status>([&](auto _){ return grpc::Status::OK; },
         [](auto err) { Logger::error(err.error_message()); return err; });
+    locations_.erase(request->blob_hash());
+    return status;
 
 }
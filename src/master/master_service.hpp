@@ -3,10 +3,16 @@
 //
 #pragma once
 #include "services/master_service.grpc.pb.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <grpcpp/grpcpp.h>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include "blob_location_cache.hpp"
+#include "config.hpp"
+#include "worker_table.hpp"
 
 class MasterServiceImpl final : public master::MasterService::Service {
 public:
@@ -21,9 +27,34 @@ public:
         master::GetWorkerWithBlobResponse* response) override;
     grpc::Status NotifyBlobSaved(grpc::ServerContext* context, const master::NotifyBlobSavedRequest* request,
                                  master::NotifyBlobSavedResponse* response) override;
-    grpc::Status RegisterWorker(grpc::ServerContext* context, const master::RegisterWorkerRequest* request, master::RegisterWorkerResponse* response) override;
+    grpc::Status RegisterWorker(grpc::ServerContext* context, grpc::ServerReader<master::RegisterWorkerRequest>* reader,
+                                master::RegisterWorkerResponse* response) override;
+
+    grpc::Status ReportCorruptBlob(grpc::ServerContext* context, const master::ReportCorruptBlobRequest* request,
+                                   master::ReportCorruptBlobResponse* response) override;
+    grpc::Status Heartbeat(grpc::ServerContext* context, const master::HeartbeatRequest* request,
+                           master::HeartbeatResponse* response) override;
+    /// How often the worker table picks up the changes of the other masters.
+    constexpr static auto WORKER_TABLE_REFRESH_INTERVAL = std::chrono::seconds(5);
+
     explicit MasterServiceImpl(MasterDbRepository* db);
     grpc::Status DeleteBlob(grpc::ServerContext* context, const master::DeleteBlobRequest* request, master::DeleteBlobResponse* response) override;
 private:
     MasterDbRepository *db;
+    WorkerTable workers_;
+    BlobLocationCache locations_{[] {
+        BlobLocationCache::Options options;
+        options.min_workers = BlobStoreConfig::REPLICATION_FACTOR;
+        return options;
+    }()};
+    std::mutex refresh_mutex_;
+    std::condition_variable_any refresh_wakeup_;
+    std::jthread refresher_; // last, so it's joined before the rest is destroyed
+
+    void refresh_workers();
+    /// Adds the deltas to the worker's space and keeps the worker table up to date.
+    auto adjust_worker_space(const std::string& worker_address, int64_t available_delta_mb, int64_t locked_delta_mb)
+        -> Expected<std::monostate, grpc::Status>;
+    /// RegisterWorker of a running worker (state_only): the state again, the blob copies as they are.
+    grpc::Status recreate_worker_state(const std::string& address, int64_t space_available);
 };
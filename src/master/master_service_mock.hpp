@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <logging.hpp>
+#include <channel_pool.hpp>
 #include <grpcpp/create_channel.h>
 #include <services/master_service.grpc.pb.h>
 #include <services/worker_service.grpc.pb.h>
@@ -40,6 +41,9 @@ public:
         master::GetWorkerWithBlobResponse* response) override
     {
         response->set_addresses(mock_workers.front());
+        for (const auto& worker: mock_workers) {
+            response->add_replicas(worker);
+        }
         return grpc::Status::OK;
     }
     grpc::Status DeleteBlob(grpc::ServerContext* context, const master::DeleteBlobRequest* request,
@@ -48,7 +52,7 @@ public:
         Logger::info("Delete blob ", request->blob_hash(), " request received");
 
         auto worker_address = mock_workers.front();
-        const auto worker_stub = worker::WorkerService::NewStub(grpc::CreateChannel(worker_address, grpc::InsecureChannelCredentials()));
+        const auto worker_stub = ChannelPool::instance().stub<worker::WorkerService>(worker_address);
 
         worker::DeleteBlobRequest worker_request;
         worker_request.set_blob_hash(request->blob_hash());
@@ -0,0 +1,169 @@
+#pragma once
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <grpcpp/grpcpp.h>
+#include "master_db_repository.hpp"
+
+/// In-memory copy of the worker_state table, so placing a blob picks its workers without a query.
+/// The masters share the table (a blob is placed on the workers of other masters too), so the copy
+/// is only a hint: every write of this master goes through it, the writes of the others show up on
+/// the next refresh (replace_all), and the placement transaction re-checks the picked workers.
+/// It also keeps the load of the workers from their heartbeats, to pick the replica a blob is read from.
+/// Example usage:
+///   table.replace_all(db.getWorkerStates().value());
+///   const auto workers = table.pick(size_mb, 3, now - timeout);
+///   ...commit the placement, then table.put(state) for each updated worker...
+class WorkerTable {
+public:
+    /// Load of a worker as of its last heartbeat.
+    struct Load {
+        uint32_t streams_in_flight = 0;
+        double io_latency_us = 0;
+        uint32_t reads_routed = 0; // reads sent to the worker since, which the heartbeat doesn't count yet
+    };
+
+private:
+    /// Keeps a worker with no latency measured yet (or a tiny one) from drawing all the reads.
+    constexpr static double LATENCY_FLOOR_US = 100;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, WorkerStateDTO> workers_;
+    std::unordered_map<std::string, Load> loads_; // not from the database, so replace_all keeps them
+    std::mt19937 random_{std::random_device{}()};
+
+    /// Expected wait for a read: the reads ahead of it times the time each takes.
+    [[nodiscard]] double cost_locked(const std::string& worker_address) const
+    {
+        const auto it = loads_.find(worker_address);
+        const auto load = it == loads_.end() ? Load() : it->second;
+        return (load.streams_in_flight + load.reads_routed + 1) * (load.io_latency_us + LATENCY_FLOOR_US);
+    }
+
+public:
+    void replace_all(const std::vector<WorkerStateDTO>& workers)
+    {
+        std::lock_guard lock(mutex_);
+        workers_.clear();
+        for (const auto& worker : workers) {
+            workers_.insert_or_assign(worker.worker_address, worker);
+        }
+    }
+
+    void put(const WorkerStateDTO& worker)
+    {
+        std::lock_guard lock(mutex_);
+        workers_.insert_or_assign(worker.worker_address, worker);
+    }
+
+    void remove(const std::string& worker_address)
+    {
+        std::lock_guard lock(mutex_);
+        workers_.erase(worker_address);
+    }
+
+    [[nodiscard]] std::optional<WorkerStateDTO> get(const std::string& worker_address) const
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = workers_.find(worker_address);
+        return it == workers_.end() ? std::nullopt : std::optional(it->second);
+    }
+
+    /// Updates the worker's free space and heartbeat time, false if the worker isn't in the table.
+    bool record_heartbeat(const std::string& worker_address, const int64_t available_space_mb, const int64_t epoch_ts)
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = workers_.find(worker_address);
+        if (it == workers_.end()) {
+            return false;
+        }
+        it->second.available_space_mb = available_space_mb;
+        it->second.last_heartbeat_epoch_ts = epoch_ts;
+        return true;
+    }
+
+    void record_load(const std::string& worker_address, const uint32_t streams_in_flight, const double io_latency_us)
+    {
+        std::lock_guard lock(mutex_);
+        loads_.insert_or_assign(worker_address, Load{streams_in_flight, io_latency_us, 0});
+    }
+
+    [[nodiscard]] std::optional<Load> load(const std::string& worker_address) const
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = loads_.find(worker_address);
+        return it == loads_.end() ? std::nullopt : std::optional(it->second);
+    }
+
+    /// Orders the replicas of a blob to read it from. The first one is the less loaded of two picked at random
+    /// (power of two choices): the least loaded one of all would draw every read of a hot blob until the next
+    /// heartbeat. The rest follow from the least loaded, for the frontend to fall back or hedge to.
+    /// The first one counts the read in its load.
+    [[nodiscard]] std::vector<std::string> order_for_read(std::vector<std::string> replicas)
+    {
+        std::lock_guard lock(mutex_);
+        if (replicas.size() < 2) {
+            return replicas;
+        }
+        std::uniform_int_distribution<size_t> pick(0, replicas.size() - 1);
+        const auto first = pick(random_);
+        auto second = pick(random_);
+        while (second == first) {
+            second = pick(random_);
+        }
+        const auto chosen = cost_locked(replicas[second]) < cost_locked(replicas[first]) ? second : first;
+        std::swap(replicas[0], replicas[chosen]);
+        std::vector<std::pair<double, std::string>> rest;
+        for (size_t i = 1; i < replicas.size(); i++) {
+            rest.emplace_back(cost_locked(replicas[i]), std::move(replicas[i]));
+        }
+        std::ranges::sort(rest, {}, &std::pair<double, std::string>::first);
+        for (size_t i = 1; i < replicas.size(); i++) {
+            replicas[i] = std::move(rest[i - 1].second);
+        }
+        loads_[replicas[0]].reads_routed++;
+        return replicas;
+    }
+
+    /// True if the worker's last heartbeat is older than alive_since. A worker that isn't in the table
+    /// (e.g. registered at another master since the last refresh) isn't taken for dead.
+    [[nodiscard]] bool is_stale(const std::string& worker_address, const int64_t alive_since) const
+    {
+        std::lock_guard lock(mutex_);
+        const auto it = workers_.find(worker_address);
+        return it != workers_.end() && it->second.last_heartbeat_epoch_ts < alive_since;
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        std::lock_guard lock(mutex_);
+        return workers_.size();
+    }
+
+    /// Up to num_workers workers with at least size_mb of free space and a heartbeat since alive_since,
+    /// the ones with the most free space first, so the blobs spread over the workers. Fewer if there aren't enough.
+    [[nodiscard]] std::vector<std::string> pick(const int64_t size_mb, const size_t num_workers,
+                                                const int64_t alive_since) const
+    {
+        std::vector<std::pair<int64_t, const std::string*>> candidates;
+        std::lock_guard lock(mutex_);
+        for (const auto& [address, worker] : workers_) {
+            const auto free_mb = worker.available_space_mb - worker.locked_space_mb;
+            if (free_mb >= size_mb && worker.last_heartbeat_epoch_ts >= alive_since) {
+                candidates.emplace_back(free_mb, &address);
+            }
+        }
+        const auto count = std::min(num_workers, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                          [](const auto& a, const auto& b) { return a.first > b.first; });
+        std::vector<std::string> picked;
+        for (size_t i = 0; i < count; i++) {
+            picked.push_back(*candidates[i].second);
+        }
+        return picked;
+    }
+};
@@ -0,0 +1,109 @@
+#include "blob_scrubber.hpp"
+#include "blob_hasher.hpp"
+#include "logging.hpp"
+
+BlobScrubber::BlobScrubber(std::shared_ptr<IndexedBlobStorage> storage, const Options options, BusyCheck busy,
+                           CorruptHandler on_corrupt)
+    : storage_(std::move(storage)), options_(options), busy_(std::move(busy)), on_corrupt_(std::move(on_corrupt)),
+      next_read_at_(std::chrono::steady_clock::now()) {}
+
+BlobScrubber::~BlobScrubber()
+{
+    stop_.request_stop();
+}
+
+void BlobScrubber::start()
+{
+    thread_ = std::jthread([this] { run(); });
+}
+
+bool BlobScrubber::sleep_until(const std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock lock(wakeup_mutex_);
+    wakeup_.wait_until(lock, stop_.get_token(), deadline, [] { return false; });
+    return !stop_.stop_requested();
+}
+
+bool BlobScrubber::throttle(const uint64_t bytes)
+{
+    while (busy_ && busy_()) {
+        if (!sleep_until(std::chrono::steady_clock::now() + options_.busy_backoff)) {
+            return false;
+        }
+    }
+    // Unused budget doesn't pile up, a scrub after a long pause isn't a burst.
+    const auto now = std::chrono::steady_clock::now();
+    next_read_at_ = std::max(next_read_at_, now);
+    const auto wait = next_read_at_;
+    next_read_at_ += std::chrono::nanoseconds(bytes * 1'000'000'000 / std::max<uint64_t>(options_.bytes_per_second, 1));
+    return wait <= now || sleep_until(wait);
+}
+
+bool BlobScrubber::scrub(const std::string& blob_hash, const uint64_t size)
+{
+    try {
+        const auto reader = storage_->open(blob_hash);
+        if (reader->size() != size) {
+            Logger::error("Scrubber: blob ", blob_hash, " has ", reader->size(), " bytes instead of ", size);
+            return false;
+        }
+        BlobHasher hasher;
+        std::string chunk;
+        for (uint64_t position = 0; position < size; position += BlobStoreConfig::MAX_CHUNK_SIZE) {
+            const auto chunk_size = std::min(BlobStoreConfig::MAX_CHUNK_SIZE, size - position);
+            if (!throttle(chunk_size)) {
+                return true; // stopped, nothing found
+            }
+            reader->read(position, chunk_size, chunk); // verifies the chunk checksums
+            hasher += chunk;
+        }
+        if (hasher.finalize() != blob_hash) {
+            Logger::error("Scrubber: blob ", blob_hash, " doesn't match its hash");
+            return false;
+        }
+        return true;
+    } catch (const BlobStorage::CorruptBlobException& cbe) {
+        Logger::error("Scrubber: ", cbe.what());
+        return false;
+    } catch (const BlobFile::FileSystemException& fse) {
+        if (!storage_->contains(blob_hash)) {
+            return true; // removed in the meantime
+        }
+        Logger::error("Scrubber: can't read blob ", blob_hash, ": ", fse.what());
+        return false;
+    }
+}
+
+size_t BlobScrubber::scrub_all()
+{
+    const auto start = std::chrono::steady_clock::now();
+    size_t corrupt = 0;
+    uint64_t bytes = 0;
+    const auto inventory = storage_->inventory();
+    for (const auto& blob : inventory) {
+        if (stop_.stop_requested()) {
+            break;
+        }
+        if (!scrub(blob.hash, blob.size_bytes)) {
+            corrupt++;
+            if (on_corrupt_) {
+                on_corrupt_(blob.hash);
+            }
+        }
+        bytes += blob.size_bytes;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start);
+    Logger::info("Scrubber: checked ", inventory.size(), " blobs (", bytes >> 20, " MB) in ", elapsed.count(),
+                 " s, ", corrupt, " corrupt");
+    return corrupt;
+}
+
+void BlobScrubber::run()
+{
+    while (!stop_.stop_requested()) {
+        scrub_all();
+        if (!sleep_until(std::chrono::steady_clock::now() + options_.pass_interval)) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include "indexed_blob_storage.hpp"
+
+/// Re-reads the stored blobs in the background and checks them against their chunk checksums and
+/// their hash, so a corrupt copy is found before a client downloads it.
+/// - Reads at most bytes_per_second, and waits while the worker is busy with requests (busy()).
+/// - A full pass is followed by pass_interval of rest.
+/// - on_corrupt(hash) gets the corrupt blobs (to report and repair them), called on the scrubber thread.
+/// Example usage:
+///   BlobScrubber scrubber(storage, options, [&] { return service.busy(); }, [&](auto& hash) { ... });
+///   scrubber.start();
+class BlobScrubber
+{
+public:
+    struct Options {
+        uint64_t bytes_per_second = 32 * 1024 * 1024;
+        std::chrono::milliseconds pass_interval = std::chrono::hours(1);
+        std::chrono::milliseconds busy_backoff = std::chrono::milliseconds(100);
+    };
+    using BusyCheck = std::function<bool()>;
+    using CorruptHandler = std::function<void(const std::string& blob_hash)>;
+
+    BlobScrubber(std::shared_ptr<IndexedBlobStorage> storage, Options options, BusyCheck busy,
+                 CorruptHandler on_corrupt);
+    ~BlobScrubber();
+    BlobScrubber(const BlobScrubber&) = delete;
+    BlobScrubber& operator=(const BlobScrubber&) = delete;
+
+    /// Starts the background passes.
+    void start();
+    /// Checks every stored blob once. Returns the number of corrupt ones.
+    size_t scrub_all();
+    /// Checks one blob. False if it's corrupt (on_corrupt isn't called).
+    bool scrub(const std::string& blob_hash, uint64_t size);
+
+private:
+    std::shared_ptr<IndexedBlobStorage> storage_;
+    Options options_;
+    BusyCheck busy_;
+    CorruptHandler on_corrupt_;
+
+    std::stop_source stop_;
+    std::mutex wakeup_mutex_;
+    std::condition_variable_any wakeup_;
+    std::chrono::steady_clock::time_point next_read_at_; // the read budget
+    std::jthread thread_;
+
+    /// False if stopped in the meantime.
+    bool sleep_until(std::chrono::steady_clock::time_point deadline);
+    /// Waits until reading bytes fits the budget and the worker isn't busy. False if stopped.
+    bool throttle(uint64_t bytes);
+    void run();
+};
@@ -0,0 +1,117 @@
+#include "blob_storage.hpp"
+#include "io_uring.hpp"
+#include "logging.hpp"
+
+namespace {
+
+/// Writer: BlobFile::Writer or UringFileWriter.
+template <typename Writer>
+class FileUpload final : public BlobStorage::Upload
+{
+    BlobFile blob_file_;
+    BlobFile::Durability durability_;
+    Writer writer_;
+    uint64_t size_ = 0;
+    bool committed_ = false;
+public:
+    FileUpload(const std::string& upload_key, const BlobFile::Durability durability,
+               const std::optional<uint64_t> blob_size)
+        : blob_file_(BlobFile::Stage(upload_key)), durability_(durability),
+          writer_(blob_file_, durability, blob_size) {}
+
+    ~FileUpload() override
+    {
+        if (committed_) {
+            return;
+        }
+        // Not BlobFile::remove, which throws - out of a destructor that would terminate the worker.
+        std::error_code error;
+        fs::remove(blob_file_.path(), error);
+        if (error) {
+            Logger::error("Failed to remove staged file ", blob_file_.path().string(), ": ", error.message());
+        }
+    }
+
+    void append(const std::string_view chunk) override
+    {
+        writer_.append(chunk);
+        size_ += chunk.size();
+    }
+
+    void commit(const std::string& blob_hash) override
+    {
+        writer_.commit();
+        // Atomic: readers see either no blob or the whole of it, never a partial file.
+        blob_file_.rename(blob_hash);
+        // From here on the file is the stored blob (maybe an existing copy), it mustn't be removed on a failure.
+        committed_ = true;
+        if (durability_ != BlobFile::Durability::None) {
+            BlobFile::sync_directory();
+        }
+    }
+
+    [[nodiscard]] uint64_t stored_size() const override { return size_; }
+};
+
+/// FileReader: BlobFile::Reader or UringFileReader.
+template <typename FileReader>
+class BlobFileReader final : public BlobStorage::Reader
+{
+    uint64_t size_;
+    FileReader reader_;
+public:
+    template <typename... Args>
+    explicit BlobFileReader(const uint64_t size, Args&&... reader_args)
+        : size_(size), reader_(std::forward<Args>(reader_args)...) {}
+
+    [[nodiscard]] uint64_t size() const override { return size_; }
+
+    void read(const uint64_t offset, const uint64_t length, std::string& out) override
+    {
+        reader_.read(offset, length, out);
+    }
+
+    void advise_sequential(const uint64_t offset, const uint64_t length) override
+    {
+        reader_.advise(offset, length, POSIX_FADV_SEQUENTIAL);
+    }
+
+    void drop_cached(const uint64_t offset, const uint64_t length) override
+    {
+        reader_.advise(offset, length, POSIX_FADV_DONTNEED);
+    }
+};
+
+}
+
+FileBlobStorage::FileBlobStorage(const BlobFile::Durability durability, const bool use_io_uring)
+    : durability_(durability), use_io_uring_(use_io_uring)
+{
+    if (use_io_uring_ && !IoUring::supported()) {
+        Logger::warn("io_uring is not available, falling back to synchronous I/O");
+        use_io_uring_ = false;
+    }
+}
+
+std::unique_ptr<BlobStorage::Upload> FileBlobStorage::start_upload(const std::string& upload_key,
+                                                                   const std::optional<uint64_t> blob_size)
+{
+    if (use_io_uring_) {
+        return std::make_unique<FileUpload<UringFileWriter>>(upload_key, durability_, blob_size);
+    }
+    return std::make_unique<FileUpload<BlobFile::Writer>>(upload_key, durability_, blob_size);
+}
+
+std::unique_ptr<BlobStorage::Reader> FileBlobStorage::open(const std::string& blob_hash)
+{
+    const auto blob_file = BlobFile::Load(blob_hash);
+    if (use_io_uring_) {
+        return std::make_unique<BlobFileReader<UringFileReader>>(blob_file.size(), blob_file.path(), blob_file.size());
+    }
+    return std::make_unique<BlobFileReader<BlobFile::Reader>>(blob_file.size(), blob_file.path());
+}
+
+bool FileBlobStorage::remove(const std::string& blob_hash)
+{
+    return BlobFile::Remove(blob_hash);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "blob_file.hpp"
+
+/// Where the worker keeps the blobs. All methods throw BlobFile::FileSystemException on I/O errors.
+/// Example usage:
+///   auto upload = storage.start_upload(upload_id, blob_size);
+///   upload->append(chunk_0);
+///   upload->append(chunk_1);
+///   upload->commit(blob_hash); // readable with storage.open(blob_hash) from now on
+class BlobStorage
+{
+public:
+    /// Thrown by reads which found the stored data damaged.
+    struct CorruptBlobException final : public BlobFile::FileSystemException {
+        explicit CorruptBlobException(const std::string& what) : FileSystemException(what) {}
+    };
+
+    /// A blob being written. Nothing is readable until commit(), an upload destroyed
+    /// without commit() drops the data.
+    class Upload
+    {
+    public:
+        virtual ~Upload() = default;
+        virtual void append(std::string_view chunk) = 0;
+        /// Makes the blob durable (according to the storage's policy) and readable under blob_hash.
+        virtual void commit(const std::string& blob_hash) = 0;
+        /// Bytes the committed blob takes on disk.
+        [[nodiscard]] virtual uint64_t stored_size() const = 0;
+    };
+
+    /// Reads byte ranges of one stored blob.
+    class Reader
+    {
+    public:
+        virtual ~Reader() = default;
+        [[nodiscard]] virtual uint64_t size() const = 0;
+        /// Replaces the content of out with bytes [offset, offset + length) of the blob.
+        virtual void read(uint64_t offset, uint64_t length, std::string& out) = 0;
+        /// Hints that [offset, offset + length) is about to be read front to back.
+        virtual void advise_sequential(uint64_t offset, uint64_t length) {}
+        /// Hints that [offset, offset + length) won't be read again soon, so it can leave the page cache.
+        virtual void drop_cached(uint64_t offset, uint64_t length) {}
+        /// The stored checksum (BlobHasher::checksum) of [offset, offset + length), if it's one whole
+        /// checksummed chunk of the blob.
+        [[nodiscard]] virtual std::optional<uint64_t> checksum(uint64_t offset, uint64_t length) const
+        {
+            return std::nullopt;
+        }
+    };
+
+    virtual ~BlobStorage() = default;
+
+    /// upload_key names the upload until it's committed (the blob hash, or a temporary upload id).
+    /// blob_size is the final size, if known.
+    virtual std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) = 0;
+    /// Throws FileSystemException, if there is no such blob.
+    virtual std::unique_ptr<Reader> open(const std::string& blob_hash) = 0;
+    /// True if the blob was there.
+    virtual bool remove(const std::string& blob_hash) = 0;
+};
+
+/// Every blob in its own file, blobs/<hash>.
+/// With io_uring the chunk writes of an upload are queued, so they overlap with receiving the next
+/// chunks, and reads keep the next chunks in flight. Where io_uring isn't available, it falls back
+/// to the synchronous pwrite / pread.
+class FileBlobStorage final : public BlobStorage
+{
+    BlobFile::Durability durability_;
+    bool use_io_uring_;
+public:
+    explicit FileBlobStorage(BlobFile::Durability durability = BlobFile::Durability::None, bool use_io_uring = false);
+
+    std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) override;
+    std::unique_ptr<Reader> open(const std::string& blob_hash) override;
+    bool remove(const std::string& blob_hash) override;
+};
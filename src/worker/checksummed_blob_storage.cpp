@@ -0,0 +1,203 @@
+#include "checksummed_blob_storage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "blob_hasher.hpp"
+#include "logging.hpp"
+
+using FileSystemException = BlobFile::FileSystemException;
+
+class ChecksummedBlobStorage::ChecksummedUpload final : public Upload
+{
+    BlobStorage& storage_;
+    std::string key_;
+    std::unique_ptr<Upload> upload_;
+    std::unique_ptr<XXH64_state_t, decltype(&XXH64_freeState)> state_{XXH64_createState(), &XXH64_freeState};
+    uint64_t in_chunk_ = 0; // bytes of the current chunk hashed so far
+    std::vector<uint64_t> checksums_;
+    uint64_t sidecar_size_ = 0;
+
+    void finish_chunk()
+    {
+        checksums_.push_back(XXH64_digest(state_.get()));
+        XXH64_reset(state_.get(), 0);
+        in_chunk_ = 0;
+    }
+
+public:
+    ChecksummedUpload(BlobStorage& storage, std::string upload_key, std::unique_ptr<Upload> upload)
+        : storage_(storage), key_(std::move(upload_key)), upload_(std::move(upload))
+    {
+        if (!state_) {
+            throw FileSystemException("Failed to create the checksum state");
+        }
+        XXH64_reset(state_.get(), 0);
+    }
+
+    void append(const std::string_view chunk) override
+    {
+        upload_->append(chunk);
+        for (auto rest = chunk; !rest.empty();) {
+            const auto size = std::min<uint64_t>(CHUNK_SIZE - in_chunk_, rest.size());
+            XXH64_update(state_.get(), rest.data(), size);
+            rest.remove_prefix(size);
+            in_chunk_ += size;
+            if (in_chunk_ == CHUNK_SIZE) {
+                finish_chunk();
+            }
+        }
+    }
+
+    void commit(const std::string& blob_hash) override
+    {
+        if (in_chunk_ > 0) {
+            finish_chunk();
+        }
+        if (checksums_.size() > 1) {
+            // First the sidecar, so a readable blob always has its checksums.
+            const auto sidecar = storage_.start_upload(key_ + SIDECAR_SUFFIX, checksums_.size() * sizeof(uint64_t));
+            sidecar->append(std::string_view(reinterpret_cast<const char*>(checksums_.data()),
+                                             checksums_.size() * sizeof(uint64_t)));
+            sidecar->commit(blob_hash + SIDECAR_SUFFIX);
+            sidecar_size_ = sidecar->stored_size();
+        }
+        upload_->commit(blob_hash);
+    }
+
+    [[nodiscard]] uint64_t stored_size() const override { return upload_->stored_size() + sidecar_size_; }
+};
+
+class ChecksummedBlobStorage::ChecksummedReader final : public Reader
+{
+    std::unique_ptr<Reader> reader_;
+    std::string blob_hash_;
+    std::vector<uint64_t> checksums_;
+    std::string chunk_;
+    std::optional<uint64_t> chunk_index_; // the verified chunk in chunk_
+
+    [[nodiscard]] uint64_t chunk_length(const uint64_t index) const
+    {
+        return std::min(CHUNK_SIZE, reader_->size() - index * CHUNK_SIZE);
+    }
+
+    void verify(const uint64_t index, const std::string_view data) const
+    {
+        if (BlobHasher::checksum(data) != checksums_[index]) {
+            throw CorruptBlobException("Checksum mismatch in chunk " + std::to_string(index) + " of blob " + blob_hash_);
+        }
+    }
+
+    void load_chunk(const uint64_t index)
+    {
+        if (chunk_index_ == index) {
+            return;
+        }
+        chunk_index_.reset();
+        reader_->read(index * CHUNK_SIZE, chunk_length(index), chunk_);
+        verify(index, chunk_);
+        chunk_index_ = index;
+    }
+
+public:
+    ChecksummedReader(std::unique_ptr<Reader> reader, std::string blob_hash, std::vector<uint64_t> checksums)
+        : reader_(std::move(reader)), blob_hash_(std::move(blob_hash)), checksums_(std::move(checksums)) {}
+
+    [[nodiscard]] uint64_t size() const override { return reader_->size(); }
+
+    void read(const uint64_t offset, const uint64_t length, std::string& out) override
+    {
+        if (length == 0 || offset + length > reader_->size()) {
+            reader_->read(offset, length, out); // nothing to verify, or the underlying error
+            return;
+        }
+        const auto first = offset / CHUNK_SIZE;
+        const auto last = (offset + length - 1) / CHUNK_SIZE;
+        if (offset % CHUNK_SIZE == 0 && offset + length == last * CHUNK_SIZE + chunk_length(last)) {
+            // Whole chunks (the usual streaming read) are read straight into out and verified there.
+            reader_->read(offset, length, out);
+            for (auto index = first; index <= last; index++) {
+                verify(index, std::string_view(out).substr((index - first) * CHUNK_SIZE, chunk_length(index)));
+            }
+            return;
+        }
+
+        // Partial chunks have to be read whole to be verified.
+        out.resize(length);
+        for (uint64_t done = 0; done < length;) {
+            const auto index = (offset + done) / CHUNK_SIZE;
+            const auto from = (offset + done) % CHUNK_SIZE;
+            const auto size = std::min(length - done, chunk_length(index) - from);
+            load_chunk(index);
+            std::memcpy(out.data() + done, chunk_.data() + from, size);
+            done += size;
+        }
+    }
+
+    void advise_sequential(const uint64_t offset, const uint64_t length) override
+    {
+        reader_->advise_sequential(offset, length);
+    }
+
+    void drop_cached(const uint64_t offset, const uint64_t length) override
+    {
+        reader_->drop_cached(offset, length);
+    }
+
+    [[nodiscard]] std::optional<uint64_t> checksum(const uint64_t offset, const uint64_t length) const override
+    {
+        const auto index = offset / CHUNK_SIZE;
+        if (offset % CHUNK_SIZE != 0 || index >= checksums_.size() || length != chunk_length(index)) {
+            return std::nullopt;
+        }
+        return checksums_[index];
+    }
+};
+
+ChecksummedBlobStorage::ChecksummedBlobStorage(std::shared_ptr<BlobStorage> storage) : storage_(std::move(storage)) {}
+
+std::unique_ptr<BlobStorage::Upload> ChecksummedBlobStorage::start_upload(const std::string& upload_key,
+                                                                          const std::optional<uint64_t> blob_size)
+{
+    return std::make_unique<ChecksummedUpload>(*storage_, upload_key, storage_->start_upload(upload_key, blob_size));
+}
+
+std::unique_ptr<BlobStorage::Reader> ChecksummedBlobStorage::open(const std::string& blob_hash)
+{
+    auto reader = storage_->open(blob_hash);
+    const auto chunk_count = (reader->size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if (chunk_count == 0) {
+        return reader;
+    }
+
+    std::vector<uint64_t> checksums(chunk_count);
+    if (chunk_count == 1) {
+        try {
+            checksums[0] = std::stoull(blob_hash);
+        } catch (const std::exception&) {
+            return reader; // not a content hash
+        }
+        return std::make_unique<ChecksummedReader>(std::move(reader), blob_hash, std::move(checksums));
+    }
+
+    std::unique_ptr<Reader> sidecar;
+    try {
+        sidecar = storage_->open(blob_hash + SIDECAR_SUFFIX);
+    } catch (const FileSystemException&) {
+        return reader; // stored without checksums
+    }
+    if (sidecar->size() != chunk_count * sizeof(uint64_t)) {
+        Logger::warn("Checksums of blob ", blob_hash, " don't match its size, reading it unverified");
+        return reader;
+    }
+    std::string buffer;
+    sidecar->read(0, sidecar->size(), buffer);
+    std::memcpy(checksums.data(), buffer.data(), buffer.size());
+    return std::make_unique<ChecksummedReader>(std::move(reader), blob_hash, std::move(checksums));
+}
+
+bool ChecksummedBlobStorage::remove(const std::string& blob_hash)
+{
+    const bool removed = storage_->remove(blob_hash);
+    storage_->remove(blob_hash + SIDECAR_SUFFIX);
+    return removed;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "blob_storage.hpp"
+
+/// Keeps per-chunk checksums (BlobHasher::checksum of every CHUNK_SIZE piece of the blob) on top of
+/// another storage, so a range of a huge blob can be verified without hashing all of it.
+/// Reads verify every chunk they touch and throw CorruptBlobException on a mismatch, and
+/// Reader::checksum() hands out the stored checksums to be sent with the chunks.
+/// - The table of a blob bigger than one chunk is stored as a sidecar blob "<hash>.sums",
+///   committed before the blob itself. A blob of one chunk needs none, its hash is the checksum.
+/// - Blobs without a sidecar (stored before it was introduced) are read unverified.
+class ChecksummedBlobStorage final : public BlobStorage
+{
+public:
+    constexpr static uint64_t CHUNK_SIZE = BlobStoreConfig::MAX_CHUNK_SIZE;
+    constexpr static auto SIDECAR_SUFFIX = ".sums";
+
+    explicit ChecksummedBlobStorage(std::shared_ptr<BlobStorage> storage);
+
+    std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) override;
+    std::unique_ptr<Reader> open(const std::string& blob_hash) override;
+    bool remove(const std::string& blob_hash) override;
+
+private:
+    class ChecksummedUpload;
+    class ChecksummedReader;
+
+    std::shared_ptr<BlobStorage> storage_;
+};
@@ -0,0 +1,286 @@
+#include "compressed_blob_storage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <zstd.h>
+
+using FileSystemException = BlobFile::FileSystemException;
+
+namespace {
+
+/// After this many chunks in a row that didn't compress, the rest of the blob is stored raw.
+constexpr uint32_t MAX_INCOMPRESSIBLE_IN_ROW = 4;
+
+}
+
+class CompressedBlobStorage::CompressedUpload final : public Upload
+{
+    const Options& options_;
+    std::unique_ptr<Upload> upload_;
+    std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context_{ZSTD_createCCtx(), &ZSTD_freeCCtx};
+    std::string pending_; // the chunk being filled
+    std::string compressed_;
+    std::vector<ChunkEntry> table_;
+    uint64_t original_size_ = 0;
+    uint64_t stored_chunks_size_ = 0;
+    uint32_t incompressible_in_row_ = 0;
+
+    void flush_chunk()
+    {
+        ChunkEntry entry {static_cast<uint32_t>(pending_.size()), 0};
+        if (incompressible_in_row_ < MAX_INCOMPRESSIBLE_IN_ROW) {
+            compressed_.resize(ZSTD_compressBound(pending_.size()));
+            const auto size = ZSTD_compressCCtx(context_.get(), compressed_.data(), compressed_.size(),
+                                                pending_.data(), pending_.size(), options_.level);
+            if (!ZSTD_isError(size) && size * 100 <= pending_.size() * (100 - options_.min_saving_percent)) {
+                entry = ChunkEntry {static_cast<uint32_t>(size), 1};
+                incompressible_in_row_ = 0;
+            } else {
+                incompressible_in_row_++;
+            }
+        }
+        upload_->append(entry.compressed ? std::string_view(compressed_.data(), entry.stored_size)
+                                         : std::string_view(pending_));
+        stored_chunks_size_ += entry.stored_size;
+        table_.push_back(entry);
+        pending_.clear();
+    }
+
+public:
+    CompressedUpload(const Options& options, std::unique_ptr<Upload> upload)
+        : options_(options), upload_(std::move(upload))
+    {
+        if (!context_) {
+            throw FileSystemException("Failed to create a zstd context");
+        }
+        pending_.reserve(CHUNK_SIZE);
+    }
+
+    void append(std::string_view chunk) override
+    {
+        original_size_ += chunk.size();
+        if (!options_.compress) {
+            upload_->append(chunk);
+            return;
+        }
+        while (!chunk.empty()) {
+            const auto size = std::min<size_t>(CHUNK_SIZE - pending_.size(), chunk.size());
+            pending_.append(chunk.substr(0, size));
+            chunk.remove_prefix(size);
+            if (pending_.size() == CHUNK_SIZE) {
+                flush_chunk();
+            }
+        }
+    }
+
+    void commit(const std::string& blob_hash) override
+    {
+        if (!options_.compress || (table_.empty() && pending_.size() < options_.min_blob_bytes)) {
+            const Trailer trailer {RAW_TRAILER_MAGIC, original_size_, original_size_, 0, 0};
+            upload_->append(pending_);
+            upload_->append(std::string_view(reinterpret_cast<const char*>(&trailer), sizeof(trailer)));
+        } else {
+            if (!pending_.empty()) {
+                flush_chunk();
+            }
+            const Trailer trailer {TRAILER_MAGIC, original_size_, stored_chunks_size_, CHUNK_SIZE,
+                                   static_cast<uint32_t>(table_.size())};
+            upload_->append(std::string_view(reinterpret_cast<const char*>(table_.data()),
+                                             table_.size() * sizeof(ChunkEntry)));
+            upload_->append(std::string_view(reinterpret_cast<const char*>(&trailer), sizeof(trailer)));
+        }
+        upload_->commit(blob_hash);
+    }
+
+    [[nodiscard]] uint64_t stored_size() const override { return upload_->stored_size(); }
+};
+
+class CompressedBlobStorage::CompressedReader final : public Reader
+{
+    std::unique_ptr<Reader> reader_;
+    Trailer trailer_;
+    std::vector<ChunkEntry> table_;
+    std::vector<uint64_t> offsets_; // where each chunk starts in the stored blob
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context_{ZSTD_createDCtx(), &ZSTD_freeDCtx};
+    std::string stored_;
+    std::string chunk_;
+    std::optional<uint64_t> chunk_index_; // the chunk decompressed in chunk_
+
+    [[nodiscard]] uint64_t chunk_length(const uint64_t index) const
+    {
+        return std::min<uint64_t>(trailer_.chunk_size, trailer_.original_size - index * trailer_.chunk_size);
+    }
+
+    void load_chunk(const uint64_t index)
+    {
+        if (chunk_index_ == index) {
+            return;
+        }
+        chunk_index_.reset();
+        reader_->read(offsets_[index], table_[index].stored_size, stored_);
+        chunk_.resize(chunk_length(index));
+        const auto size = ZSTD_decompressDCtx(context_.get(), chunk_.data(), chunk_.size(), stored_.data(), stored_.size());
+        if (ZSTD_isError(size) || size != chunk_.size()) {
+            throw CorruptBlobException("Failed to decompress chunk " + std::to_string(index) + ": " +
+                                      (ZSTD_isError(size) ? ZSTD_getErrorName(size) : "wrong size"));
+        }
+        chunk_index_ = index;
+    }
+
+    /// The stored bytes of the chunks holding [offset, offset + length): {offset, length}.
+    [[nodiscard]] std::pair<uint64_t, uint64_t> stored_range(const uint64_t offset, const uint64_t length) const
+    {
+        if (length == 0 || offset + length > trailer_.original_size) {
+            return {0, 0};
+        }
+        const auto first = offset / trailer_.chunk_size;
+        const auto last = (offset + length - 1) / trailer_.chunk_size;
+        return {offsets_[first], offsets_[last] + table_[last].stored_size - offsets_[first]};
+    }
+
+public:
+    CompressedReader(std::unique_ptr<Reader> reader, const Trailer& trailer, std::vector<ChunkEntry> table)
+        : reader_(std::move(reader)), trailer_(trailer), table_(std::move(table))
+    {
+        if (!context_) {
+            throw FileSystemException("Failed to create a zstd context");
+        }
+        uint64_t offset = 0;
+        for (const auto& entry : table_) {
+            offsets_.push_back(offset);
+            offset += entry.stored_size;
+        }
+    }
+
+    [[nodiscard]] uint64_t size() const override { return trailer_.original_size; }
+
+    void read(const uint64_t offset, const uint64_t length, std::string& out) override
+    {
+        if (offset + length > trailer_.original_size) {
+            throw FileSystemException("Read past the end of the blob");
+        }
+        const auto first_index = offset / trailer_.chunk_size;
+        const auto in_chunk = offset % trailer_.chunk_size;
+        if (length > 0 && !table_[first_index].compressed && in_chunk + length <= chunk_length(first_index)) {
+            // Within one raw chunk, read straight into out.
+            reader_->read(offsets_[first_index] + in_chunk, length, out);
+            return;
+        }
+
+        out.resize(length);
+        for (uint64_t done = 0; done < length;) {
+            const auto position = offset + done;
+            const auto index = position / trailer_.chunk_size;
+            const auto from = position % trailer_.chunk_size;
+            const auto size = std::min(length - done, chunk_length(index) - from);
+            if (table_[index].compressed) {
+                load_chunk(index);
+                std::memcpy(out.data() + done, chunk_.data() + from, size);
+            } else {
+                reader_->read(offsets_[index] + from, size, stored_);
+                std::memcpy(out.data() + done, stored_.data(), size);
+            }
+            done += size;
+        }
+    }
+
+    void advise_sequential(const uint64_t offset, const uint64_t length) override
+    {
+        const auto [stored_offset, stored_length] = stored_range(offset, length);
+        if (stored_length > 0) {
+            reader_->advise_sequential(stored_offset, stored_length);
+        }
+    }
+
+    void drop_cached(const uint64_t offset, const uint64_t length) override
+    {
+        const auto [stored_offset, stored_length] = stored_range(offset, length);
+        if (stored_length > 0) {
+            reader_->drop_cached(stored_offset, stored_length);
+        }
+    }
+};
+
+/// The first size bytes of the stored blob, without the raw trailer.
+class CompressedBlobStorage::RawReader final : public Reader
+{
+    std::unique_ptr<Reader> reader_;
+    uint64_t size_;
+
+public:
+    RawReader(std::unique_ptr<Reader> reader, const uint64_t size) : reader_(std::move(reader)), size_(size) {}
+
+    [[nodiscard]] uint64_t size() const override { return size_; }
+
+    void read(const uint64_t offset, const uint64_t length, std::string& out) override
+    {
+        if (offset + length > size_) {
+            throw FileSystemException("Read past the end of the blob");
+        }
+        reader_->read(offset, length, out);
+    }
+
+    void advise_sequential(const uint64_t offset, const uint64_t length) override
+    {
+        if (offset < size_) {
+            reader_->advise_sequential(offset, std::min(length, size_ - offset));
+        }
+    }
+
+    void drop_cached(const uint64_t offset, const uint64_t length) override
+    {
+        if (offset < size_) {
+            reader_->drop_cached(offset, std::min(length, size_ - offset));
+        }
+    }
+};
+
+CompressedBlobStorage::CompressedBlobStorage(std::shared_ptr<BlobStorage> storage, const Options options)
+    : storage_(std::move(storage)), options_(options) {}
+
+std::unique_ptr<BlobStorage::Upload> CompressedBlobStorage::start_upload(const std::string& upload_key,
+                                                                         const std::optional<uint64_t> blob_size)
+{
+    return std::make_unique<CompressedUpload>(options_, storage_->start_upload(upload_key, blob_size));
+}
+
+std::unique_ptr<BlobStorage::Reader> CompressedBlobStorage::open(const std::string& blob_hash)
+{
+    auto reader = storage_->open(blob_hash);
+    const auto stored_size = reader->size();
+    if (stored_size < sizeof(Trailer)) {
+        return reader;
+    }
+
+    std::string buffer;
+    reader->read(stored_size - sizeof(Trailer), sizeof(Trailer), buffer);
+    Trailer trailer {};
+    std::memcpy(&trailer, buffer.data(), sizeof(trailer));
+    if (trailer.magic == RAW_TRAILER_MAGIC && trailer.table_offset == trailer.original_size &&
+        trailer.original_size + sizeof(Trailer) == stored_size) {
+        return std::make_unique<RawReader>(std::move(reader), trailer.original_size);
+    }
+    const bool valid = trailer.magic == TRAILER_MAGIC && trailer.chunk_size > 0 &&
+                       trailer.chunk_count == (trailer.original_size + trailer.chunk_size - 1) / trailer.chunk_size &&
+                       trailer.table_offset + trailer.chunk_count * sizeof(ChunkEntry) + sizeof(Trailer) == stored_size;
+    if (!valid) {
+        return reader; // stored raw
+    }
+
+    std::vector<ChunkEntry> table(trailer.chunk_count);
+    reader->read(trailer.table_offset, table.size() * sizeof(ChunkEntry), buffer);
+    std::memcpy(table.data(), buffer.data(), buffer.size());
+    uint64_t chunks_size = 0;
+    for (const auto& entry : table) {
+        chunks_size += entry.stored_size;
+    }
+    if (chunks_size != trailer.table_offset) {
+        return reader;
+    }
+    return std::make_unique<CompressedReader>(std::move(reader), trailer, std::move(table));
+}
+
+bool CompressedBlobStorage::remove(const std::string& blob_hash)
+{
+    return storage_->remove(blob_hash);
+}
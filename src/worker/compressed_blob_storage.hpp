@@ -0,0 +1,53 @@
+#pragma once
+#include "blob_storage.hpp"
+
+/// Compresses blobs chunk by chunk (zstd) on top of another storage. Readers get the original bytes,
+/// and range reads decompress only the chunks they touch.
+/// A compressed blob is stored as: the chunks (compressed or raw), a table of their stored sizes,
+/// and a Trailer. A blob stored raw (a small one) is followed by a Trailer with RAW_TRAILER_MAGIC, so
+/// a blob whose own bytes end like a trailer is never decoded. Only the blobs stored before this
+/// layer was installed have no trailer, they are read as they are.
+/// Adaptive bypass: a chunk that doesn't shrink by at least min_saving_percent is stored raw,
+/// and after a few such chunks in a row the rest of the blob isn't even tried.
+class CompressedBlobStorage final : public BlobStorage
+{
+public:
+    struct Options {
+        /// Off, new blobs are stored raw - the blobs stored compressed before are still decoded.
+        bool compress = true;
+        int level = 1;
+        uint32_t min_saving_percent = 10;
+        /// Blobs smaller than this are stored raw, compressing them isn't worth it.
+        uint64_t min_blob_bytes = 4096;
+    };
+
+    struct Trailer {
+        uint64_t magic;
+        uint64_t original_size;
+        uint64_t table_offset;
+        uint32_t chunk_size;
+        uint32_t chunk_count;
+    };
+    struct ChunkEntry {
+        uint32_t stored_size;
+        uint32_t compressed; // 0 - raw, 1 - zstd
+    };
+    constexpr static uint64_t TRAILER_MAGIC = 0x31465a53424f4c42; // "BLOBSZF1"
+    /// A raw blob: original_size bytes, then the trailer (table_offset == original_size, no chunks).
+    constexpr static uint64_t RAW_TRAILER_MAGIC = 0x31525a53424f4c42; // "BLOBSZR1"
+    constexpr static uint32_t CHUNK_SIZE = BlobStoreConfig::MAX_CHUNK_SIZE;
+
+    CompressedBlobStorage(std::shared_ptr<BlobStorage> storage, Options options);
+
+    std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) override;
+    std::unique_ptr<Reader> open(const std::string& blob_hash) override;
+    bool remove(const std::string& blob_hash) override;
+
+private:
+    class CompressedUpload;
+    class CompressedReader;
+    class RawReader;
+
+    std::shared_ptr<BlobStorage> storage_;
+    Options options_;
+};
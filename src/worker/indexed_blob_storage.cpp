@@ -0,0 +1,232 @@
+#include "indexed_blob_storage.hpp"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "logging.hpp"
+
+using FileSystemException = BlobFile::FileSystemException;
+
+namespace {
+
+constexpr uint64_t MIN_ENTRIES_TO_REWRITE = 1024;
+
+void write_all(const int fd, const std::string& data, const fs::path& path)
+{
+    uint64_t done = 0;
+    while (done < data.size()) {
+        const auto bytes_written = ::write(fd, data.data() + done, data.size() - done);
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written < 0) {
+            throw FileSystemException("Failed to write " + path.string() + ": " + std::strerror(errno));
+        }
+        done += bytes_written;
+    }
+}
+
+void sync_parent_directory(const fs::path& path)
+{
+    const auto directory = path.has_parent_path() ? path.parent_path() : fs::path(".");
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || ::fsync(fd) != 0) {
+        const auto error = std::string(std::strerror(errno));
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw FileSystemException("Failed to sync directory " + directory.string() + ": " + error);
+    }
+    ::close(fd);
+}
+
+}
+
+class IndexedBlobStorage::IndexedUpload final : public Upload
+{
+    IndexedBlobStorage& storage_;
+    std::unique_ptr<Upload> upload_;
+    uint64_t size_ = 0;
+public:
+    IndexedUpload(IndexedBlobStorage& storage, std::unique_ptr<Upload> upload)
+        : storage_(storage), upload_(std::move(upload)) {}
+
+    void append(const std::string_view chunk) override
+    {
+        upload_->append(chunk);
+        size_ += chunk.size();
+    }
+
+    void commit(const std::string& blob_hash) override
+    {
+        upload_->commit(blob_hash);
+        storage_.add(blob_hash, size_);
+    }
+
+    [[nodiscard]] uint64_t stored_size() const override { return upload_->stored_size(); }
+};
+
+IndexedBlobStorage::IndexedBlobStorage(std::shared_ptr<BlobStorage> storage, fs::path journal_path,
+                                       const BlobFile::Durability durability)
+    : storage_(std::move(storage)), journal_path_(std::move(journal_path)), durability_(durability)
+{
+    if (journal_path_.has_parent_path()) {
+        fs::create_directories(journal_path_.parent_path());
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    if (load()) {
+        rewrite();
+    } else {
+        open_journal();
+    }
+    Logger::info("Loaded index of ", blobs_.size(), " blobs in ",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                 " ms");
+}
+
+IndexedBlobStorage::~IndexedBlobStorage()
+{
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+}
+
+bool IndexedBlobStorage::load()
+{
+    std::ifstream journal(journal_path_, std::ios::binary);
+    if (!journal.is_open()) {
+        return false;
+    }
+    const std::string content((std::istreambuf_iterator(journal)), std::istreambuf_iterator<char>());
+
+    size_t line_start = 0;
+    for (size_t line_end; (line_end = content.find('\n', line_start)) != std::string::npos; line_start = line_end + 1) {
+        std::istringstream line(content.substr(line_start, line_end - line_start));
+        char operation = 0;
+        std::string hash;
+        uint64_t size = 0;
+        line >> operation >> hash;
+        if (operation == '+' && line >> size) {
+            blobs_[hash] = size;
+        } else if (operation == '-') {
+            blobs_.erase(hash);
+        } else {
+            Logger::warn("Skipping a corrupted entry in ", journal_path_, ": ", line.str());
+        }
+        journal_entries_++;
+    }
+
+    const bool torn_tail = line_start < content.size(); // the last entry wasn't fully written
+    if (torn_tail) {
+        Logger::warn("Dropping a partial entry at the end of ", journal_path_);
+    }
+    return torn_tail || journal_entries_ > std::max(MIN_ENTRIES_TO_REWRITE, 2 * blobs_.size());
+}
+
+void IndexedBlobStorage::rewrite()
+{
+    const auto temp_path = fs::path(journal_path_.string() + ".tmp");
+    std::string content;
+    for (const auto& [hash, size] : blobs_) {
+        content += "+ " + hash + " " + std::to_string(size) + "\n";
+    }
+
+    const int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw FileSystemException("Failed to open " + temp_path.string() + ": " + std::strerror(errno));
+    }
+    try {
+        write_all(fd, content, temp_path);
+        if (::fdatasync(fd) != 0) {
+            throw FileSystemException("Failed to sync " + temp_path.string() + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    std::error_code error;
+    fs::rename(temp_path, journal_path_, error);
+    if (error) {
+        throw FileSystemException("Failed to rename " + temp_path.string() + " to " + journal_path_.string());
+    }
+    sync_parent_directory(journal_path_);
+    journal_entries_ = blobs_.size();
+
+    if (journal_fd_ >= 0) {
+        ::close(journal_fd_);
+    }
+    open_journal();
+}
+
+void IndexedBlobStorage::open_journal()
+{
+    journal_fd_ = ::open(journal_path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (journal_fd_ < 0) {
+        throw FileSystemException("Failed to open " + journal_path_.string() + ": " + std::strerror(errno));
+    }
+}
+
+void IndexedBlobStorage::append_entry(const std::string& entry)
+{
+    write_all(journal_fd_, entry, journal_path_);
+    if (durability_ != BlobFile::Durability::None && ::fdatasync(journal_fd_) != 0) {
+        throw FileSystemException("Failed to sync " + journal_path_.string() + ": " + std::strerror(errno));
+    }
+    journal_entries_++;
+    if (journal_entries_ > std::max(MIN_ENTRIES_TO_REWRITE, 2 * blobs_.size())) {
+        rewrite();
+    }
+}
+
+void IndexedBlobStorage::add(const std::string& blob_hash, const uint64_t size)
+{
+    std::lock_guard lock(mutex_);
+    if (const auto it = blobs_.find(blob_hash); it != blobs_.end() && it->second == size) {
+        return;
+    }
+    blobs_[blob_hash] = size;
+    append_entry("+ " + blob_hash + " " + std::to_string(size) + "\n");
+}
+
+std::unique_ptr<BlobStorage::Upload> IndexedBlobStorage::start_upload(const std::string& upload_key,
+                                                                      const std::optional<uint64_t> blob_size)
+{
+    return std::make_unique<IndexedUpload>(*this, storage_->start_upload(upload_key, blob_size));
+}
+
+std::unique_ptr<BlobStorage::Reader> IndexedBlobStorage::open(const std::string& blob_hash)
+{
+    return storage_->open(blob_hash);
+}
+
+bool IndexedBlobStorage::remove(const std::string& blob_hash)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (blobs_.erase(blob_hash) > 0) {
+            append_entry("- " + blob_hash + "\n");
+        }
+    }
+    return storage_->remove(blob_hash);
+}
+
+std::vector<IndexedBlobStorage::StoredBlob> IndexedBlobStorage::inventory() const
+{
+    std::lock_guard lock(mutex_);
+    std::vector<StoredBlob> inventory;
+    inventory.reserve(blobs_.size());
+    for (const auto& [hash, size] : blobs_) {
+        inventory.push_back(StoredBlob{hash, size});
+    }
+    return inventory;
+}
+
+bool IndexedBlobStorage::contains(const std::string& blob_hash) const
+{
+    std::lock_guard lock(mutex_);
+    return blobs_.contains(blob_hash);
+}
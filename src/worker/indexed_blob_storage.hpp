@@ -0,0 +1,52 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "blob_storage.hpp"
+
+/// Keeps a persisted index of the stored blobs on top of another storage, so the worker knows
+/// what it has right after a restart - without walking blobs/ or scanning the storage.
+/// The index is a journal of "+ <hash> <size>" and "- <hash>" lines, replayed at startup and
+/// rewritten when it's mostly made of overwritten entries. A blob is journaled after it's committed
+/// and unjournaled before it's removed, so a crash leaves at most an unindexed file, never an index
+/// entry without the blob. (The hash is the XXH64 of the content, so it doubles as the checksum.)
+class IndexedBlobStorage final : public BlobStorage
+{
+public:
+    struct StoredBlob {
+        std::string hash;
+        uint64_t size_bytes;
+    };
+
+    IndexedBlobStorage(std::shared_ptr<BlobStorage> storage, fs::path journal_path, BlobFile::Durability durability);
+    ~IndexedBlobStorage() override;
+    IndexedBlobStorage(const IndexedBlobStorage&) = delete;
+    IndexedBlobStorage& operator=(const IndexedBlobStorage&) = delete;
+
+    std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) override;
+    std::unique_ptr<Reader> open(const std::string& blob_hash) override;
+    bool remove(const std::string& blob_hash) override;
+
+    [[nodiscard]] std::vector<StoredBlob> inventory() const;
+    [[nodiscard]] bool contains(const std::string& blob_hash) const;
+
+private:
+    class IndexedUpload;
+
+    std::shared_ptr<BlobStorage> storage_;
+    fs::path journal_path_;
+    BlobFile::Durability durability_;
+
+    mutable std::mutex mutex_; // guards everything below
+    int journal_fd_ = -1;
+    uint64_t journal_entries_ = 0;
+    std::unordered_map<std::string, uint64_t> blobs_; // hash -> size
+
+    /// Replays the journal. True if it should be rewritten.
+    bool load();
+    /// Writes the live entries into a new journal, which atomically replaces the old one.
+    void rewrite();
+    void open_journal();
+    void append_entry(const std::string& entry);
+    void add(const std::string& blob_hash, uint64_t size);
+};
@@ -0,0 +1,395 @@
+#include "io_uring.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using FileSystemException = BlobFile::FileSystemException;
+
+///---- IoUring ----///
+IoUring::IoUring(const unsigned entries)
+{
+    io_uring_params params {};
+    ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0) {
+        throw FileSystemException(std::string("io_uring_setup failed: ") + std::strerror(errno));
+    }
+    entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    const auto map = [this](const size_t size, const off_t offset) {
+        void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        if (ptr == MAP_FAILED) {
+            const auto error = std::string(std::strerror(errno));
+            release();
+            throw FileSystemException("Failed to map the io_uring: " + error);
+        }
+        return ptr;
+    };
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+    const auto sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    const auto cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring()
+{
+    release();
+}
+
+void IoUring::release()
+{
+    if (sqes_) {
+        ::munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        ::munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        ::munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (ring_fd_ >= 0) {
+        ::close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+bool IoUring::supported()
+{
+    static const bool supported = [] {
+        try {
+            IoUring ring(2);
+            return true;
+        } catch (const FileSystemException&) {
+            return false;
+        }
+    }();
+    return supported;
+}
+
+void IoUring::push(const io_uring_sqe& sqe)
+{
+    if (in_flight_ >= entries_) {
+        throw FileSystemException("io_uring is full");
+    }
+    // Only this thread moves the tail, the kernel reads it.
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & sq_mask_;
+    sqes_[index] = sqe;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+    in_flight_++;
+}
+
+void IoUring::prepare_read(const int fd, char* buffer, const uint32_t size, const uint64_t offset,
+                           const uint64_t user_data)
+{
+    io_uring_sqe sqe {};
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = size;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+void IoUring::prepare_write(const int fd, const char* buffer, const uint32_t size, const uint64_t offset,
+                            const uint64_t user_data)
+{
+    io_uring_sqe sqe {};
+    sqe.opcode = IORING_OP_WRITE;
+    sqe.fd = fd;
+    sqe.addr = reinterpret_cast<uint64_t>(buffer);
+    sqe.len = size;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+    push(sqe);
+}
+
+void IoUring::enter(const unsigned min_complete)
+{
+    while (true) {
+        const auto submitted = ::syscall(__NR_io_uring_enter, ring_fd_, to_submit_, min_complete,
+                                         min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted < 0 && errno == EINTR) {
+            continue;
+        }
+        if (submitted < 0) {
+            throw FileSystemException(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+        to_submit_ -= static_cast<unsigned>(submitted);
+        return;
+    }
+}
+
+void IoUring::submit()
+{
+    if (to_submit_ > 0) {
+        enter(0);
+    }
+}
+
+std::optional<IoUring::Completion> IoUring::pop_completion()
+{
+    const unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return std::nullopt;
+    }
+    const auto& cqe = cqes_[head & cq_mask_];
+    const Completion completion {cqe.user_data, cqe.res};
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    in_flight_--;
+    return completion;
+}
+
+IoUring::Completion IoUring::wait_completion()
+{
+    while (true) {
+        if (const auto completion = pop_completion()) {
+            return *completion;
+        }
+        if (in_flight_ == 0) {
+            throw FileSystemException("Waiting for an io_uring completion with nothing in flight");
+        }
+        enter(1);
+    }
+}
+
+///---- UringFileWriter ----///
+UringFileWriter::UringFileWriter(const BlobFile& blob_file, const BlobFile::Durability durability,
+                                 const std::optional<uint64_t> expected_size)
+    : path_(blob_file.path()), durability_(durability), ring_(QUEUE_DEPTH), written_(blob_file.size()),
+      buffers_(QUEUE_DEPTH), buffer_offsets_(QUEUE_DEPTH)
+{
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw FileSystemException("Failed to open file " + path_.string() + " for appending: " + std::strerror(errno));
+    }
+    if (expected_size && *expected_size > written_) {
+        // Best effort, not every filesystem can do it.
+        ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(written_),
+                    static_cast<off_t>(*expected_size - written_));
+    }
+    for (unsigned i = 0; i < QUEUE_DEPTH; i++) {
+        free_buffers_.push_back(i);
+    }
+}
+
+UringFileWriter::~UringFileWriter()
+{
+    // The kernel may still be writing from the buffers, they can't be freed before every write completed.
+    // io_uring_enter fails here only transiently (EAGAIN, EBUSY), so it's retried.
+    while (ring_.in_flight() > 0) {
+        try {
+            ring_.wait_completion();
+        } catch (const FileSystemException&) {}
+    }
+    ::close(fd_);
+}
+
+void UringFileWriter::reap(const IoUring::Completion& completion)
+{
+    const auto index = static_cast<unsigned>(completion.user_data);
+    const auto& buffer = buffers_[index];
+    if (completion.result < 0) {
+        error_ = "Failed to write file " + path_.string() + ": " + std::strerror(-completion.result);
+    } else {
+        // A short write, the rest is written synchronously.
+        for (uint64_t done = completion.result; done < buffer.size() && !error_;) {
+            const auto bytes_written = ::pwrite(fd_, buffer.data() + done, buffer.size() - done,
+                                                static_cast<off_t>(buffer_offsets_[index] + done));
+            if (bytes_written < 0 && errno != EINTR) {
+                error_ = "Failed to write file " + path_.string() + ": " + std::strerror(errno);
+            } else if (bytes_written == 0) {
+                error_ = "Failed to write file " + path_.string() + ": no bytes written";
+            }
+            done += std::max<ssize_t>(bytes_written, 0);
+        }
+    }
+    free_buffers_.push_back(index);
+}
+
+void UringFileWriter::throw_if_failed() const
+{
+    if (error_) {
+        throw FileSystemException(*error_);
+    }
+}
+
+void UringFileWriter::append(const std::string_view chunk)
+{
+    while (free_buffers_.empty()) {
+        reap(ring_.wait_completion());
+    }
+    throw_if_failed();
+
+    const auto index = free_buffers_.back();
+    free_buffers_.pop_back();
+    buffers_[index].assign(chunk);
+    buffer_offsets_[index] = written_;
+    ring_.prepare_write(fd_, buffers_[index].data(), static_cast<uint32_t>(chunk.size()), written_, index);
+    ring_.submit();
+    written_ += chunk.size();
+}
+
+void UringFileWriter::commit()
+{
+    while (ring_.in_flight() > 0) {
+        reap(ring_.wait_completion());
+    }
+    throw_if_failed();
+    if (durability_ == BlobFile::Durability::None) {
+        return;
+    }
+    if (::fdatasync(fd_) != 0) {
+        throw FileSystemException("Failed to sync file " + path_.string() + ": " + std::strerror(errno));
+    }
+}
+
+///---- UringFileReader ----///
+UringFileReader::UringFileReader(fs::path path, const uint64_t file_size)
+    : path_(std::move(path)), file_size_(file_size), ring_(QUEUE_DEPTH), slots_(QUEUE_DEPTH)
+{
+    fd_ = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw FileSystemException("Failed to open file " + path_.string() + ": " + std::strerror(errno));
+    }
+    for (unsigned i = 0; i < QUEUE_DEPTH; i++) {
+        free_slots_.push_back(i);
+    }
+}
+
+UringFileReader::~UringFileReader()
+{
+    // The kernel may still be reading into the slots, they can't be freed before every read completed.
+    // io_uring_enter fails here only transiently (EAGAIN, EBUSY), so it's retried.
+    while (ring_.in_flight() > 0) {
+        try {
+            complete(ring_.wait_completion());
+        } catch (const FileSystemException&) {}
+    }
+    ::close(fd_);
+}
+
+void UringFileReader::complete(const IoUring::Completion& completion)
+{
+    auto& slot = slots_[completion.user_data];
+    slot.done = true;
+    slot.result = completion.result;
+}
+
+void UringFileReader::wait_for(const unsigned slot)
+{
+    while (!slots_[slot].done) {
+        complete(ring_.wait_completion());
+    }
+}
+
+void UringFileReader::drain()
+{
+    while (ring_.in_flight() > 0) {
+        complete(ring_.wait_completion());
+    }
+    for (const auto slot : ahead_) {
+        free_slots_.push_back(slot);
+    }
+    ahead_.clear();
+}
+
+void UringFileReader::read_ahead(const uint64_t length)
+{
+    while (length > 0 && !free_slots_.empty() && next_offset_ < file_size_) {
+        const auto index = free_slots_.back();
+        free_slots_.pop_back();
+        auto& slot = slots_[index];
+        slot.offset = next_offset_;
+        slot.length = std::min(length, file_size_ - next_offset_);
+        slot.buffer.resize(slot.length);
+        slot.done = false;
+        ring_.prepare_read(fd_, slot.buffer.data(), static_cast<uint32_t>(slot.length), slot.offset, index);
+        ahead_.push_back(index);
+        next_offset_ += slot.length;
+    }
+    ring_.submit();
+}
+
+void UringFileReader::finish_read(Slot& slot)
+{
+    if (slot.result < 0) {
+        throw FileSystemException("Failed to read file " + path_.string() + " at " + std::to_string(slot.offset) +
+                                  ": " + std::strerror(-slot.result));
+    }
+    if (static_cast<uint64_t>(slot.result) < slot.length) {
+        // A short read, the rest is read synchronously.
+        std::string rest;
+        BlobFile::Reader(path_).read(slot.offset + slot.result, slot.length - slot.result, rest);
+        std::memcpy(slot.buffer.data() + slot.result, rest.data(), rest.size());
+    }
+}
+
+void UringFileReader::read(const uint64_t offset, const uint64_t length, std::string& out)
+{
+    if (!ahead_.empty() && slots_[ahead_.front()].offset == offset && slots_[ahead_.front()].length == length) {
+        const auto index = ahead_.front();
+        ahead_.pop_front();
+        try {
+            wait_for(index);
+            finish_read(slots_[index]);
+        } catch (const FileSystemException&) {
+            // A slot the kernel may still read into goes back to the read-ahead, drain() frees it later.
+            if (slots_[index].done) {
+                free_slots_.push_back(index);
+            } else {
+                ahead_.push_front(index);
+            }
+            throw;
+        }
+        std::swap(out, slots_[index].buffer); // out's old buffer is reused for the next read ahead
+        free_slots_.push_back(index);
+    } else {
+        drain();
+        out.resize(length);
+        uint64_t done = 0;
+        while (done < length) {
+            const auto bytes_read = ::pread(fd_, out.data() + done, length - done, static_cast<off_t>(offset + done));
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_read <= 0) {
+                throw FileSystemException("Failed to read file " + path_.string() + " at " +
+                                          std::to_string(offset + done) + ": " +
+                                          (bytes_read < 0 ? std::strerror(errno) : "unexpected end of file"));
+            }
+            done += bytes_read;
+        }
+        next_offset_ = offset + length;
+    }
+    read_ahead(length);
+}
+
+void UringFileReader::advise(const uint64_t offset, const uint64_t length, const int advice) const
+{
+    ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(length), advice);
+}
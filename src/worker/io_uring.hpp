@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <linux/io_uring.h>
+#include "blob_file.hpp"
+
+/// A minimal io_uring (submission and completion queue shared with the kernel) on the raw syscalls,
+/// without liburing. Used by one thread at a time.
+/// Example usage:
+///   IoUring ring(8);
+///   ring.prepare_read(fd, buffer, size, offset, /*user_data*/ 1);
+///   ring.submit();
+///   auto completion = ring.wait_completion(); // completion.result = bytes read or -errno
+class IoUring
+{
+public:
+    struct Completion {
+        uint64_t user_data;
+        int32_t result;
+    };
+
+    /// Throws BlobFile::FileSystemException, if the kernel doesn't allow io_uring.
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /// Whether io_uring can be used here (it's often disabled in containers), checked once.
+    static bool supported();
+
+    void prepare_read(int fd, char* buffer, uint32_t size, uint64_t offset, uint64_t user_data);
+    void prepare_write(int fd, const char* buffer, uint32_t size, uint64_t offset, uint64_t user_data);
+    /// Hands the prepared entries to the kernel, without waiting.
+    void submit();
+    /// Returns the next completion, submitting the prepared entries and waiting if there is none yet.
+    Completion wait_completion();
+    [[nodiscard]] unsigned in_flight() const { return in_flight_; }
+
+private:
+    int ring_fd_ = -1;
+    unsigned entries_ = 0;
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned to_submit_ = 0;
+    unsigned in_flight_ = 0; // prepared or submitted, not completed yet
+
+    void push(const io_uring_sqe& sqe);
+    std::optional<Completion> pop_completion();
+    void enter(unsigned min_complete);
+    void release();
+};
+
+/// BlobFile writer (see BlobFile::Writer) which keeps up to QUEUE_DEPTH chunk writes in flight,
+/// so writing a chunk overlaps with receiving the next ones from the network.
+/// Each chunk is copied into one of the writer's buffers, the caller's data can go right away.
+/// Durability::Direct is done as Fdatasync - O_DIRECT needs block aligned writes, the chunks aren't.
+class UringFileWriter
+{
+    constexpr static unsigned QUEUE_DEPTH = 8;
+
+    fs::path path_;
+    BlobFile::Durability durability_;
+    int fd_ = -1;
+    IoUring ring_;
+    uint64_t written_ = 0; // bytes passed to the ring
+    std::vector<std::string> buffers_;
+    std::vector<uint64_t> buffer_offsets_;
+    std::vector<unsigned> free_buffers_;
+    std::optional<std::string> error_;
+
+    void reap(const IoUring::Completion& completion);
+    void throw_if_failed() const;
+
+public:
+    UringFileWriter(const BlobFile& blob_file, BlobFile::Durability durability, std::optional<uint64_t> expected_size);
+    ~UringFileWriter();
+    UringFileWriter(const UringFileWriter&) = delete;
+    UringFileWriter& operator=(const UringFileWriter&) = delete;
+
+    void append(std::string_view chunk);
+    /// Waits for the writes in flight and makes the file durable according to the policy, but not its
+    /// directory entry (see BlobFile::Writer::commit).
+    void commit();
+};
+
+/// BlobFile reader (see BlobFile::Reader) which, after a read, reads the following ranges of the same
+/// length ahead, up to QUEUE_DEPTH in flight. A sequential scan then finds its data already read,
+/// any other read drops the read-ahead and is done with a plain pread.
+class UringFileReader
+{
+    constexpr static unsigned QUEUE_DEPTH = 4;
+
+    struct Slot {
+        uint64_t offset = 0;
+        uint64_t length = 0;
+        std::string buffer;
+        bool done = false;
+        int32_t result = 0;
+    };
+
+    fs::path path_;
+    uint64_t file_size_;
+    int fd_ = -1;
+    IoUring ring_;
+    std::vector<Slot> slots_;
+    std::vector<unsigned> free_slots_;
+    std::deque<unsigned> ahead_; // slots in flight or done, in file order
+    uint64_t next_offset_ = 0;
+
+    void complete(const IoUring::Completion& completion);
+    void wait_for(unsigned slot);
+    void drain();
+    void read_ahead(uint64_t length);
+    void finish_read(Slot& slot);
+
+public:
+    UringFileReader(fs::path path, uint64_t file_size);
+    ~UringFileReader();
+    UringFileReader(const UringFileReader&) = delete;
+    UringFileReader& operator=(const UringFileReader&) = delete;
+
+    /// Replaces the content of out with bytes [offset, offset + length) of the file.
+    /// Throws BlobFile::FileSystemException, if the file is shorter or the read fails.
+    void read(uint64_t offset, uint64_t length, std::string& out);
+    /// Best effort posix_fadvise on [offset, offset + length) of the file.
+    void advise(uint64_t offset, uint64_t length, int advice) const;
+};
@@ -9,11 +9,130 @@
 #include <iostream>
 #include <thread>
 
+#include "blob_scrubber.hpp"
+#include "channel_pool.hpp"
+#include "checksummed_blob_storage.hpp"
+#include "compressed_blob_storage.hpp"
 #include "environment.hpp"
+#include "indexed_blob_storage.hpp"
 #include "logging.hpp"
+#include "packed_blob_storage.hpp"
+#include "space_ledger.hpp"
 
 using namespace std;
 
+std::shared_ptr<BlobStorage> make_blob_storage(const WorkerConfig& config)
+{
+    auto files = std::make_unique<FileBlobStorage>(config.durability, config.io_uring);
+    if (config.storage_engine == WorkerConfig::StorageEngine::Files) {
+        Logger::info("Storage engine: files");
+        return files;
+    }
+    Logger::info("Storage engine: packed, blobs up to ", config.packed_max_blob_kb, " KB go to segments");
+    PackedBlobStorage::Options options;
+    options.max_blob_bytes = config.packed_max_blob_kb * 1024;
+    options.segment_bytes = config.packed_segment_mb * 1024 * 1024;
+    return std::make_shared<PackedBlobStorage>(std::filesystem::path(BLOBS_PATH) / "segments", config.durability,
+                                               std::move(files), options);
+}
+
+/// Installed also with compression off, the blobs stored compressed before must still be decoded.
+std::shared_ptr<BlobStorage> make_compressed(const WorkerConfig& config, std::shared_ptr<BlobStorage> storage)
+{
+    if (config.compression) {
+        Logger::info("Compression: zstd, level ", config.compression_level);
+    } else {
+        Logger::info("Compression: off");
+    }
+    CompressedBlobStorage::Options options;
+    options.compress = config.compression;
+    options.level = config.compression_level;
+    return std::make_shared<CompressedBlobStorage>(std::move(storage), options);
+}
+
+/// Registers at the master with the inventory of the stored blobs, so the master keeps
+/// their copies, and with the uploads cut off by the restart. The blobs the master doesn't
+/// know about anymore get deleted.
+grpc::Status register_at_master(const std::shared_ptr<grpc::Channel>& master_channel,
+                                const std::string& worker_service_address, IndexedBlobStorage& storage,
+                                SpaceLedger& space, const std::vector<std::string>& aborted_uploads)
+{
+    constexpr size_t INVENTORY_BATCH_SIZE = 10000;
+
+    master::RegisterWorkerRequest register_worker_request;
+    register_worker_request.set_address(worker_service_address);
+    for (const auto& upload_key : aborted_uploads) {
+        register_worker_request.add_aborted_uploads(upload_key);
+    }
+    space.resync();
+    register_worker_request.set_space_available(space.available());
+
+    grpc::ClientContext client_context;
+    master::RegisterWorkerResponse register_worker_response;
+    const auto master_stub = master::MasterService::NewStub(master_channel);
+    const auto writer = master_stub->RegisterWorker(&client_context, &register_worker_response);
+
+    const auto inventory = storage.inventory();
+    Logger::info("Registering with ", inventory.size(), " stored blobs");
+    for (size_t i = 0; i <= inventory.size(); i++) {
+        const bool batch_full = register_worker_request.blobs_size() == INVENTORY_BATCH_SIZE;
+        if (batch_full || i == inventory.size()) {
+            if (!writer->Write(register_worker_request)) {
+                break;
+            }
+            register_worker_request.Clear();
+        }
+        if (i < inventory.size()) {
+            auto* blob = register_worker_request.add_blobs();
+            blob->set_hash(inventory[i].hash);
+            blob->set_size_bytes(inventory[i].size_bytes);
+        }
+    }
+    writer->WritesDone();
+    const auto status = writer->Finish();
+    if (!status.ok()) {
+        return status;
+    }
+
+    for (const auto& stale_blob : register_worker_response.stale_blobs()) {
+        Logger::info("Deleting stale blob ", stale_blob);
+        try {
+            storage.remove(stale_blob);
+        } catch (const BlobFile::FileSystemException& fse) {
+            Logger::error("Error while deleting stale blob: ", fse.what());
+        }
+    }
+    return grpc::Status::OK;
+}
+
+/// Registers a running worker again, at a master that lost its state. Unlike register_at_master,
+/// the blob copies stay as they are - the uploads in flight must still find theirs.
+grpc::Status recreate_worker_state(const std::shared_ptr<grpc::Channel>& master_channel,
+                                   const std::string& worker_service_address, const master::HeartbeatRequest& heartbeat)
+{
+    master::RegisterWorkerRequest request;
+    request.set_address(worker_service_address);
+    request.set_space_available(static_cast<int64_t>(heartbeat.free_space_bytes() + heartbeat.reserved_space_bytes()));
+    request.set_state_only(true);
+
+    grpc::ClientContext client_context;
+    master::RegisterWorkerResponse response;
+    const auto writer = master::MasterService::NewStub(master_channel)->RegisterWorker(&client_context, &response);
+    writer->Write(request);
+    writer->WritesDone();
+    return writer->Finish();
+}
+
+grpc::Status send_heartbeat(const std::string& master_address, const master::HeartbeatRequest& request)
+{
+    grpc::ClientContext client_context;
+    // A master that doesn't answer mustn't hold up the heartbeats to the others for long.
+    client_context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(500));
+    master::HeartbeatResponse response;
+    return ChannelPool::instance().stub<master::MasterService>(master_address)->Heartbeat(&client_context, request,
+                                                                                          &response);
+}
+
 void run_worker(const WorkerConfig& config)
 {
     const std::string container_port = std::to_string(config.container_port);
@@ -24,35 +143,24 @@ void run_worker(const WorkerConfig& config)
     Logger::info("My master service address: ", master_service_address);
 
     const std::string server_address("0.0.0.0:" + container_port);
-    const auto master_channel = grpc::CreateChannel(master_service_address,
-                                              grpc::InsecureChannelCredentials());
-    master::RegisterWorkerRequest register_worker_request = master::RegisterWorkerRequest();
+    const auto master_channel = ChannelPool::instance().get(master_service_address);
 
     std::filesystem::create_directories(BLOBS_PATH);
-    // Get free storage
-    register_worker_request.set_address(worker_service_address);
-    auto status = get_free_storage()
-                  .and_then([&](uint64_t storage) -> Expected<std::monostate, grpc::Status> {
-                      register_worker_request.set_space_available(storage);
-                      return std::monostate{};
-                  })
-                  .output<grpc::Status>(
-                          [](auto _) { return grpc::Status::OK; },
-                          std::identity()
-                  );
-    if (not status.ok()) {
-       Logger::error("Cannot get free storage");
-        exit(1);
-    }
+    // Recovery: the uploads that didn't complete before the restart left only staging files.
+    const auto aborted_uploads = BlobFile::RemoveStaged();
+    Logger::info("Removed ", aborted_uploads.size(), " incomplete uploads");
+    // The checksums are of the original bytes, so they're kept above the compression.
+    const auto storage = std::make_shared<IndexedBlobStorage>(
+        std::make_shared<ChecksummedBlobStorage>(make_compressed(config, make_blob_storage(config))),
+        std::filesystem::path(BLOBS_PATH) / "index.log", config.durability);
+    SpaceLedger::Options space_options;
+    space_options.safety_margin_bytes = config.space_margin_mb * 1024 * 1024;
+    const auto space = std::make_shared<SpaceLedger>(BLOBS_PATH, space_options);
 
     // Register at master service
     int tries = 10;
     while (tries--) {
-        grpc::ClientContext client_context;
-        master::RegisterWorkerResponse register_worker_response;
-        auto master_stub = master::MasterService::NewStub(master_channel);
-        status = master_stub->RegisterWorker(&client_context, register_worker_request, &register_worker_response);
-        if (status.ok()) {
+        if (register_at_master(master_channel, worker_service_address, *storage, *space, aborted_uploads).ok()) {
             break;
         }
         Logger::warn("Error during registration, trying again after 10 seconds");
@@ -62,11 +170,50 @@ void run_worker(const WorkerConfig& config)
         Logger::error("Couldn't register at master service. Is the master service running?");
     }
 
-    WorkerServiceImpl worker_service(master_channel, worker_service_address);
+    const auto admission_options = AdmissionControl::options_from(config.admission);
+    WorkerServiceImpl worker_service(master_channel, worker_service_address, storage, space,
+                                     std::make_shared<AdmissionControl>(admission_options));
+
+    std::unique_ptr<BlobScrubber> scrubber;
+    if (config.scrub_mb_per_sec > 0) {
+        Logger::info("Scrubber: ", config.scrub_mb_per_sec, " MB/s, a pass every ", config.scrub_interval_min, " min");
+        BlobScrubber::Options options;
+        options.bytes_per_second = config.scrub_mb_per_sec * 1024 * 1024;
+        options.pass_interval = std::chrono::minutes(config.scrub_interval_min);
+        scrubber = std::make_unique<BlobScrubber>(
+            storage, options, [&worker_service] { return worker_service.busy(); },
+            [&worker_service](const std::string& blob_hash) { worker_service.repair_corrupt_blob(blob_hash); });
+        scrubber->start();
+    }
+
+    // Without heartbeats the masters take the worker for dead: it gets no new blobs and no reads.
+    // Every master gets them, as any of them may route the reads of the worker's blobs.
+    const std::jthread heartbeat([&](const std::stop_token& stop) {
+        while (!stop.stop_requested()) {
+            std::this_thread::sleep_for(BlobStoreConfig::HEARTBEAT_INTERVAL);
+            auto request = worker_service.heartbeat();
+            for (const auto& master_address : config.master_services) {
+                request.set_load_only(master_address != master_service_address);
+                const auto status = send_heartbeat(master_address, request);
+                if (status.error_code() == grpc::NOT_FOUND && !request.load_only()) {
+                    // The registration at startup failed, or the master dropped the worker's state.
+                    Logger::warn("Not registered at ", master_address, ", registering again");
+                    const auto registered = recreate_worker_state(master_channel, worker_service_address, request);
+                    if (!registered.ok()) {
+                        Logger::warn("Registration failed: ", registered.error_message());
+                    }
+                } else if (!status.ok()) {
+                    Logger::warn("Heartbeat to ", master_address, " failed: ", status.error_message());
+                }
+            }
+        }
+    });
 
     // Start server
+    grpc::ServerBuilder builder;
+    AdmissionControl::configure(builder, admission_options, "worker");
     const auto server =
-        grpc::ServerBuilder()
+        builder
             .AddListeningPort(server_address, grpc::InsecureServerCredentials())
             .RegisterService(&worker_service)
             .BuildAndStart();
@@ -0,0 +1,468 @@
+#include "packed_blob_storage.hpp"
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "logging.hpp"
+
+using FileSystemException = BlobFile::FileSystemException;
+
+struct PackedBlobStorage::Segment {
+    uint32_t id;
+    fs::path path;
+    int fd;
+    uint64_t size = 0;       // bytes of valid records, the next record goes here
+    uint64_t dead_bytes = 0; // bytes of deleted or overwritten records and tombstones
+
+    Segment(const uint32_t id, fs::path path, const int fd) : id(id), path(std::move(path)), fd(fd) {}
+    ~Segment() { ::close(fd); }
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+};
+
+namespace {
+
+constexpr uint32_t MAX_KEY_SIZE = 1024;
+
+uint64_t record_size(const uint64_t key_size, const uint64_t data_size)
+{
+    return sizeof(PackedBlobStorage::RecordHeader) + key_size + data_size;
+}
+
+std::string segment_filename(const uint32_t id)
+{
+    auto name = std::to_string(id);
+    return "segment-" + std::string(8 - std::min<size_t>(8, name.size()), '0') + name + ".log";
+}
+
+std::optional<uint32_t> segment_id(const fs::path& path)
+{
+    const auto name = path.filename().string();
+    if (!name.starts_with("segment-") || !name.ends_with(".log")) {
+        return std::nullopt;
+    }
+    try {
+        return static_cast<uint32_t>(std::stoul(name.substr(8, name.size() - 8 - 4)));
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+void pread_all(const int fd, char* out, const uint64_t length, const uint64_t offset, const fs::path& path)
+{
+    uint64_t done = 0;
+    while (done < length) {
+        const auto bytes_read = ::pread(fd, out + done, length - done, static_cast<off_t>(offset + done));
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read <= 0) {
+            throw FileSystemException("Failed to read segment " + path.string() + " at " +
+                                      std::to_string(offset + done) + ": " +
+                                      (bytes_read < 0 ? std::strerror(errno) : "unexpected end of file"));
+        }
+        done += bytes_read;
+    }
+}
+
+void pwrite_all(const int fd, const char* data, const uint64_t length, const uint64_t offset, const fs::path& path)
+{
+    uint64_t done = 0;
+    while (done < length) {
+        const auto bytes_written = ::pwrite(fd, data + done, length - done, static_cast<off_t>(offset + done));
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written < 0) {
+            throw FileSystemException("Failed to write segment " + path.string() + ": " + std::strerror(errno));
+        }
+        done += bytes_written;
+    }
+}
+
+void sync_file(const int fd, const fs::path& path)
+{
+    if (::fdatasync(fd) != 0) {
+        throw FileSystemException("Failed to sync " + path.string() + ": " + std::strerror(errno));
+    }
+}
+
+void sync_directory(const fs::path& directory)
+{
+    const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw FileSystemException("Failed to open directory " + directory.string() + ": " + std::strerror(errno));
+    }
+    const auto result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw FileSystemException("Failed to sync directory " + directory.string() + ": " + std::strerror(errno));
+    }
+}
+
+}
+
+/// Keeps a small blob in memory until commit, then writes it with a single append.
+/// A blob that outgrows max_blob_bytes is handed over to the fallback storage.
+class PackedBlobStorage::PackedUpload final : public Upload
+{
+    PackedBlobStorage& storage_;
+    std::string key_;
+    std::optional<uint64_t> blob_size_;
+    std::string buffer_;
+    std::unique_ptr<Upload> spilled_;
+
+    void spill()
+    {
+        spilled_ = storage_.fallback_->start_upload(key_, blob_size_);
+        if (!buffer_.empty()) {
+            spilled_->append(buffer_);
+            buffer_ = std::string();
+        }
+    }
+
+public:
+    PackedUpload(PackedBlobStorage& storage, std::string key, const std::optional<uint64_t> blob_size)
+        : storage_(storage), key_(std::move(key)), blob_size_(blob_size)
+    {
+        if (blob_size_ && *blob_size_ > storage_.options_.max_blob_bytes) {
+            spill();
+        } else if (blob_size_) {
+            buffer_.reserve(*blob_size_);
+        }
+    }
+
+    void append(const std::string_view chunk) override
+    {
+        if (!spilled_ && buffer_.size() + chunk.size() > storage_.options_.max_blob_bytes) {
+            spill();
+        }
+        if (spilled_) {
+            spilled_->append(chunk);
+        } else {
+            buffer_.append(chunk);
+        }
+    }
+
+    void commit(const std::string& blob_hash) override
+    {
+        if (spilled_) {
+            spilled_->commit(blob_hash);
+        } else {
+            storage_.put(blob_hash, buffer_);
+        }
+    }
+
+    [[nodiscard]] uint64_t stored_size() const override
+    {
+        return spilled_ ? spilled_->stored_size() : buffer_.size();
+    }
+};
+
+/// Reads straight from the segment. Holding the segment keeps its descriptor open,
+/// so the read still works if the segment gets compacted away in the meantime.
+class PackedBlobStorage::PackedReader final : public Reader
+{
+    std::shared_ptr<Segment> segment_;
+    Location location_;
+public:
+    PackedReader(std::shared_ptr<Segment> segment, const Location location)
+        : segment_(std::move(segment)), location_(location) {}
+
+    [[nodiscard]] uint64_t size() const override { return location_.size; }
+
+    void read(const uint64_t offset, const uint64_t length, std::string& out) override
+    {
+        if (offset + length > location_.size) {
+            throw FileSystemException("Read past the end of the blob in " + segment_->path.string());
+        }
+        out.resize(length);
+        pread_all(segment_->fd, out.data(), length, location_.offset + offset, segment_->path);
+    }
+};
+
+PackedBlobStorage::PackedBlobStorage(fs::path directory, const BlobFile::Durability durability,
+                                     std::unique_ptr<BlobStorage> fallback, const Options options)
+    : directory_(std::move(directory)), durability_(durability), fallback_(std::move(fallback)), options_(options)
+{
+    load_segments();
+    compaction_thread_ = std::jthread([this](const std::stop_token& stop) { run_compaction(stop); });
+}
+
+PackedBlobStorage::~PackedBlobStorage() = default;
+
+std::shared_ptr<PackedBlobStorage::Segment> PackedBlobStorage::open_segment(const uint32_t id)
+{
+    const auto path = directory_ / segment_filename(id);
+    const bool created = !fs::exists(path);
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw FileSystemException("Failed to open segment " + path.string() + ": " + std::strerror(errno));
+    }
+    if (created && durability_ != BlobFile::Durability::None) {
+        sync_directory(directory_);
+    }
+    auto segment = std::make_shared<Segment>(id, path, fd);
+    segments_.emplace(id, segment);
+    return segment;
+}
+
+void PackedBlobStorage::load_segments()
+{
+    fs::create_directories(directory_);
+    std::vector<uint32_t> ids;
+    for (const auto& entry : fs::directory_iterator(directory_)) {
+        if (const auto id = segment_id(entry.path())) {
+            ids.push_back(*id);
+        }
+    }
+    std::ranges::sort(ids);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::lock_guard lock(mutex_);
+    for (const auto id : ids) {
+        scan_segment(*open_segment(id));
+    }
+    if (segments_.empty()) {
+        open_segment(1);
+    }
+    Logger::info("Loaded ", index_.size(), " packed blobs from ", ids.size(), " segments in ",
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                 " ms");
+}
+
+void PackedBlobStorage::scan_segment(Segment& segment)
+{
+    struct stat stat {};
+    if (::fstat(segment.fd, &stat) != 0) {
+        throw FileSystemException("Failed to stat segment " + segment.path.string() + ": " + std::strerror(errno));
+    }
+    const auto file_size = static_cast<uint64_t>(stat.st_size);
+
+    uint64_t position = 0;
+    RecordHeader header {};
+    std::string key;
+    while (position + sizeof(header) <= file_size) {
+        pread_all(segment.fd, reinterpret_cast<char*>(&header), sizeof(header), position, segment.path);
+        const bool valid = (header.magic == BLOB_MAGIC || header.magic == TOMBSTONE_MAGIC) &&
+                           header.key_size <= MAX_KEY_SIZE &&
+                           position + record_size(header.key_size, header.data_size) <= file_size;
+        if (!valid) {
+            break;
+        }
+        key.resize(header.key_size);
+        pread_all(segment.fd, key.data(), key.size(), position + sizeof(header), segment.path);
+
+        if (const auto old = index_.find(key); old != index_.end()) {
+            segments_.at(old->second.segment_id)->dead_bytes += record_size(key.size(), old->second.size);
+            index_.erase(old);
+        }
+        const auto size = record_size(header.key_size, header.data_size);
+        if (header.magic == BLOB_MAGIC) {
+            index_[key] = Location{segment.id, position + sizeof(header) + header.key_size, header.data_size};
+        } else {
+            segment.dead_bytes += size;
+        }
+        position += size;
+    }
+
+    if (position < file_size) {
+        // A record cut off by a crash, nobody has acknowledged it.
+        Logger::warn("Dropping ", file_size - position, " bytes of a partial record at the end of ", segment.path);
+        if (::ftruncate(segment.fd, static_cast<off_t>(position)) != 0) {
+            throw FileSystemException("Failed to truncate segment " + segment.path.string() + ": " +
+                                      std::strerror(errno));
+        }
+    }
+    segment.size = position;
+}
+
+PackedBlobStorage::Location PackedBlobStorage::append_record(const uint32_t magic, const std::string& key,
+                                                             const std::string_view data)
+{
+    auto active = segments_.rbegin()->second;
+    const auto size = record_size(key.size(), data.size());
+    if (active->size > 0 && active->size + size > options_.segment_bytes) {
+        active = open_segment(active->id + 1);
+    }
+
+    const RecordHeader header {magic, static_cast<uint32_t>(key.size()), data.size()};
+    std::string header_and_key(reinterpret_cast<const char*>(&header), sizeof(header));
+    header_and_key += key;
+    pwrite_all(active->fd, header_and_key.data(), header_and_key.size(), active->size, active->path);
+    pwrite_all(active->fd, data.data(), data.size(), active->size + header_and_key.size(), active->path);
+
+    const Location location {active->id, active->size + header_and_key.size(), data.size()};
+    active->size += size;
+    return location;
+}
+
+void PackedBlobStorage::put(const std::string& blob_hash, const std::string_view data)
+{
+    std::shared_ptr<Segment> segment;
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto old = index_.find(blob_hash); old != index_.end()) {
+            if (old->second.size == data.size()) {
+                return; // the same blob is already there
+            }
+            segments_.at(old->second.segment_id)->dead_bytes += record_size(blob_hash.size(), old->second.size);
+        }
+        const auto location = append_record(BLOB_MAGIC, blob_hash, data);
+        index_[blob_hash] = location;
+        segment = segments_.at(location.segment_id);
+    }
+    // Outside the lock, so concurrent uploads share the flushes. Direct is treated as Fdatasync,
+    // records in a segment aren't block aligned.
+    if (durability_ != BlobFile::Durability::None) {
+        sync_file(segment->fd, segment->path);
+    }
+}
+
+std::unique_ptr<BlobStorage::Upload> PackedBlobStorage::start_upload(const std::string& upload_key,
+                                                                     const std::optional<uint64_t> blob_size)
+{
+    return std::make_unique<PackedUpload>(*this, upload_key, blob_size);
+}
+
+std::unique_ptr<BlobStorage::Reader> PackedBlobStorage::open(const std::string& blob_hash)
+{
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto it = index_.find(blob_hash); it != index_.end()) {
+            return std::make_unique<PackedReader>(segments_.at(it->second.segment_id), it->second);
+        }
+    }
+    return fallback_->open(blob_hash);
+}
+
+bool PackedBlobStorage::remove(const std::string& blob_hash)
+{
+    std::shared_ptr<Segment> segment;
+    {
+        std::lock_guard lock(mutex_);
+        if (const auto it = index_.find(blob_hash); it != index_.end()) {
+            segments_.at(it->second.segment_id)->dead_bytes += record_size(blob_hash.size(), it->second.size);
+            index_.erase(it);
+            const auto location = append_record(TOMBSTONE_MAGIC, blob_hash, {});
+            segment = segments_.at(location.segment_id);
+            segment->dead_bytes += record_size(blob_hash.size(), 0);
+        }
+    }
+    if (segment && durability_ != BlobFile::Durability::None) {
+        sync_file(segment->fd, segment->path);
+    }
+    const bool removed_file = fallback_->remove(blob_hash);
+    return segment || removed_file;
+}
+
+size_t PackedBlobStorage::segment_count() const
+{
+    std::lock_guard lock(mutex_);
+    return segments_.size();
+}
+
+size_t PackedBlobStorage::compact()
+{
+    std::lock_guard compaction_lock(compaction_mutex_);
+    std::vector<std::shared_ptr<Segment>> candidates;
+    {
+        std::lock_guard lock(mutex_);
+        const auto active_id = segments_.rbegin()->first;
+        for (const auto& [id, segment] : segments_) {
+            if (id != active_id && segment->dead_bytes >= options_.compaction_threshold * segment->size) {
+                candidates.push_back(segment);
+            }
+        }
+    }
+    for (const auto& segment : candidates) {
+        compact_segment(segment);
+    }
+    return candidates.size();
+}
+
+void PackedBlobStorage::compact_segment(const std::shared_ptr<Segment>& segment)
+{
+    Logger::info("Compacting ", segment->path, ", ", segment->dead_bytes, " of ", segment->size, " bytes are dead");
+    std::set<uint32_t> written_segments;
+    RecordHeader header {};
+    std::string key;
+    std::string data;
+    for (uint64_t position = 0; position < segment->size;) {
+        pread_all(segment->fd, reinterpret_cast<char*>(&header), sizeof(header), position, segment->path);
+        key.resize(header.key_size);
+        pread_all(segment->fd, key.data(), key.size(), position + sizeof(header), segment->path);
+        const Location location {segment->id, position + sizeof(header) + header.key_size, header.data_size};
+        position += record_size(header.key_size, header.data_size);
+
+        if (header.magic == BLOB_MAGIC) {
+            {
+                std::lock_guard lock(mutex_);
+                const auto it = index_.find(key);
+                if (it == index_.end() || it->second.segment_id != location.segment_id ||
+                    it->second.offset != location.offset) {
+                    continue; // dead record
+                }
+            }
+            data.resize(location.size);
+            pread_all(segment->fd, data.data(), data.size(), location.offset, segment->path);
+
+            std::lock_guard lock(mutex_);
+            const auto it = index_.find(key);
+            if (it != index_.end() && it->second.segment_id == location.segment_id &&
+                it->second.offset == location.offset) {
+                it->second = append_record(BLOB_MAGIC, key, data);
+                written_segments.insert(it->second.segment_id);
+            }
+        } else {
+            // The tombstone may still hide a record in an older segment. Not if the blob was stored again:
+            // the copy would come after the new record on the next scan and delete it.
+            std::lock_guard lock(mutex_);
+            if (segments_.begin()->first < segment->id && !index_.contains(key)) {
+                const auto tombstone = append_record(TOMBSTONE_MAGIC, key, {});
+                segments_.at(tombstone.segment_id)->dead_bytes += record_size(key.size(), 0);
+                written_segments.insert(tombstone.segment_id);
+            }
+        }
+    }
+
+    std::vector<std::shared_ptr<Segment>> to_sync;
+    {
+        std::lock_guard lock(mutex_);
+        for (const auto id : written_segments) {
+            to_sync.push_back(segments_.at(id));
+        }
+        segments_.erase(segment->id);
+    }
+    // The copies must be on disk before the original disappears.
+    if (durability_ != BlobFile::Durability::None) {
+        for (const auto& written : to_sync) {
+            sync_file(written->fd, written->path);
+        }
+    }
+    fs::remove(segment->path);
+    if (durability_ != BlobFile::Durability::None) {
+        sync_directory(directory_);
+    }
+}
+
+void PackedBlobStorage::run_compaction(const std::stop_token& stop)
+{
+    while (!stop.stop_requested()) {
+        {
+            std::unique_lock lock(wakeup_mutex_);
+            compaction_wakeup_.wait_for(lock, stop, options_.compaction_interval, [] { return false; });
+        }
+        if (stop.stop_requested()) {
+            break;
+        }
+        try {
+            compact();
+        } catch (const FileSystemException& fse) {
+            Logger::error("Compaction failed: ", fse.what());
+        }
+    }
+}
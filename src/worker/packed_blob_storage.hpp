@@ -0,0 +1,86 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "blob_storage.hpp"
+
+/// Small blobs packed into large append-only segment files, instead of a file per blob.
+/// A put is one append to the active segment, a get is one pread - there are no per-blob
+/// inodes, directory entries or metadata writes.
+/// - Segment record: RecordHeader, then the key (blob hash), then the data.
+/// - The index hash -> (segment, offset, size) lives in memory, rebuilt from the segments at startup.
+/// - A delete appends a tombstone record. A background thread compacts sealed segments
+///   with mostly dead data: the live records are copied to the active segment, the old file is deleted.
+/// - Blobs bigger than max_blob_bytes go to the fallback storage (a file per blob).
+class PackedBlobStorage final : public BlobStorage
+{
+public:
+    struct Options {
+        uint64_t max_blob_bytes = 1024 * 1024;
+        uint64_t segment_bytes = 256 * 1024 * 1024;
+        /// A sealed segment gets compacted once this fraction of it is dead.
+        double compaction_threshold = 0.5;
+        std::chrono::milliseconds compaction_interval = std::chrono::seconds(30);
+    };
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t key_size;
+        uint64_t data_size;
+    };
+    constexpr static uint32_t BLOB_MAGIC = 0x424c4f42;      // "BLOB"
+    constexpr static uint32_t TOMBSTONE_MAGIC = 0x44454144; // "DEAD"
+
+    struct Segment;
+    struct Location {
+        uint32_t segment_id;
+        uint64_t offset; // of the data
+        uint64_t size;
+    };
+
+    PackedBlobStorage(fs::path directory, BlobFile::Durability durability, std::unique_ptr<BlobStorage> fallback,
+                      Options options);
+    PackedBlobStorage(fs::path directory, BlobFile::Durability durability, std::unique_ptr<BlobStorage> fallback)
+        : PackedBlobStorage(std::move(directory), durability, std::move(fallback), Options()) {}
+    ~PackedBlobStorage() override;
+
+    std::unique_ptr<Upload> start_upload(const std::string& upload_key, std::optional<uint64_t> blob_size) override;
+    std::unique_ptr<Reader> open(const std::string& blob_hash) override;
+    bool remove(const std::string& blob_hash) override;
+
+    /// Compacts the sealed segments over the threshold now. Returns the number of compacted segments.
+    size_t compact();
+    [[nodiscard]] size_t segment_count() const;
+
+private:
+    class PackedUpload;
+    class PackedReader;
+
+    fs::path directory_;
+    BlobFile::Durability durability_;
+    std::unique_ptr<BlobStorage> fallback_;
+    Options options_;
+
+    mutable std::mutex mutex_; // guards segments_ (and their sizes) and index_
+    std::map<uint32_t, std::shared_ptr<Segment>> segments_; // the last one is the active one
+    std::unordered_map<std::string, Location> index_;
+
+    std::mutex compaction_mutex_; // one compaction at a time
+    std::mutex wakeup_mutex_;
+    std::condition_variable_any compaction_wakeup_;
+    std::jthread compaction_thread_;
+
+    void load_segments();
+    void scan_segment(Segment& segment);
+    std::shared_ptr<Segment> open_segment(uint32_t id);
+    /// Appends a record to the active segment (rolling it over if it's full). Needs mutex_.
+    Location append_record(uint32_t magic, const std::string& key, std::string_view data);
+    /// Stores a committed small blob.
+    void put(const std::string& blob_hash, std::string_view data);
+    void compact_segment(const std::shared_ptr<Segment>& segment);
+    void run_compaction(const std::stop_token& stop);
+};
@@ -0,0 +1,77 @@
+#include "space_ledger.hpp"
+#include <algorithm>
+#include "logging.hpp"
+
+SpaceLedger::Reservation::~Reservation()
+{
+    std::lock_guard lock(ledger_.mutex_);
+    ledger_.reserved_ -= remaining_;
+}
+
+bool SpaceLedger::Reservation::consume(const uint64_t bytes)
+{
+    std::lock_guard lock(ledger_.mutex_);
+    const auto reserved = std::min(bytes, remaining_);
+    if (bytes > reserved && bytes - reserved > ledger_.available_locked()) {
+        return false;
+    }
+    remaining_ -= reserved;
+    ledger_.reserved_ -= reserved;
+    ledger_.written_since_resync_ += bytes;
+    return true;
+}
+
+SpaceLedger::SpaceLedger(const fs::path& directory, const Options options)
+    : SpaceLedger([directory] { return static_cast<uint64_t>(fs::space(directory).free); }, options) {}
+
+SpaceLedger::SpaceLedger(FreeSpaceProbe probe, const Options options) : probe_(std::move(probe)), options_(options) {}
+
+void SpaceLedger::resync_locked()
+{
+    // Also on failure, so a broken filesystem isn't probed on every call.
+    last_resync_ = std::chrono::steady_clock::now();
+    try {
+        free_at_resync_ = probe_();
+        written_since_resync_ = 0;
+    } catch (const fs::filesystem_error& fse) {
+        Logger::error("Error while getting free storage: ", fse.what());
+    }
+}
+
+uint64_t SpaceLedger::available_locked()
+{
+    if (!last_resync_ || std::chrono::steady_clock::now() - *last_resync_ >= options_.resync_interval) {
+        resync_locked();
+    }
+    const auto used = written_since_resync_ + reserved_ + options_.safety_margin_bytes;
+    return free_at_resync_ > used ? free_at_resync_ - used : 0;
+}
+
+void SpaceLedger::resync()
+{
+    std::lock_guard lock(mutex_);
+    resync_locked();
+}
+
+uint64_t SpaceLedger::available()
+{
+    std::lock_guard lock(mutex_);
+    return available_locked();
+}
+
+uint64_t SpaceLedger::reserved()
+{
+    std::lock_guard lock(mutex_);
+    return reserved_;
+}
+
+std::unique_ptr<SpaceLedger::Reservation> SpaceLedger::reserve(const uint64_t bytes)
+{
+    std::lock_guard lock(mutex_);
+    if (bytes > available_locked()) {
+        Logger::warn("Can't reserve ", bytes, " bytes, ", available_locked(), " available");
+        return nullptr;
+    }
+    reserved_ += bytes;
+    return std::make_unique<Reservation>(*this, bytes);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include "blob_file.hpp"
+
+/// Keeps the free space of the blob directory in memory, so asking for it doesn't cost a syscall
+/// and concurrent uploads can't be admitted into the same free space.
+/// - available = free bytes at the last resync - bytes written since - reserved bytes - safety margin
+/// - A SaveBlob stream reserves the blob size up front and draws on the reservation as it writes,
+///   a stream of unknown size grows its reservation chunk by chunk.
+/// - The free bytes are read from the filesystem again every resync_interval, which picks up
+///   deleted blobs, compression savings and whatever else writes to the disk.
+/// Example usage:
+///   const auto reservation = ledger.reserve(blob_size);
+///   if (!reservation) { /* no space */ }
+///   if (!reservation->consume(chunk.size())) { /* no space */ }
+class SpaceLedger
+{
+public:
+    struct Options {
+        uint64_t safety_margin_bytes = 64 * 1024 * 1024;
+        std::chrono::milliseconds resync_interval = std::chrono::seconds(10);
+    };
+    /// Free bytes of the filesystem, throws std::filesystem::filesystem_error.
+    using FreeSpaceProbe = std::function<uint64_t()>;
+
+    /// Space held for one upload, whatever wasn't written is given back on destruction.
+    class Reservation
+    {
+        SpaceLedger& ledger_;
+        uint64_t remaining_;
+    public:
+        Reservation(SpaceLedger& ledger, uint64_t bytes) : ledger_(ledger), remaining_(bytes) {}
+        ~Reservation();
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+
+        /// Records bytes written, growing the reservation past its size if needed.
+        /// False (and nothing recorded) if the growth doesn't fit.
+        [[nodiscard]] bool consume(uint64_t bytes);
+    };
+
+    SpaceLedger(const fs::path& directory, Options options);
+    explicit SpaceLedger(const fs::path& directory) : SpaceLedger(directory, Options()) {}
+    SpaceLedger(FreeSpaceProbe probe, Options options);
+
+    /// Bytes that can still be reserved.
+    [[nodiscard]] uint64_t available();
+    /// Bytes reserved by the uploads in progress and not written yet.
+    [[nodiscard]] uint64_t reserved();
+    /// Nullptr if the bytes don't fit.
+    [[nodiscard]] std::unique_ptr<Reservation> reserve(uint64_t bytes);
+    /// Reads the free bytes from the filesystem now.
+    void resync();
+
+private:
+    FreeSpaceProbe probe_;
+    Options options_;
+    std::mutex mutex_;
+    uint64_t free_at_resync_ = 0;
+    uint64_t written_since_resync_ = 0;
+    uint64_t reserved_ = 0; // not written yet
+    std::optional<std::chrono::steady_clock::time_point> last_resync_;
+
+    void resync_locked();
+    uint64_t available_locked();
+};
@@ -1,55 +1,153 @@
 #include "worker_service.hpp"
-#include "blob_file.hpp"
 #include "blob_hasher.hpp"
+#include "channel_pool.hpp"
 #include "expected.hpp"
 #include "logging.hpp"
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <mutex>
+#include <thread>
 #include <grpcpp/grpcpp.h>
 #include "services/worker_service.grpc.pb.h"
 #include "services/master_service.grpc.pb.h"
 
 ///---- BEGIN HELPERS ----///
-auto get_free_storage() -> Expected<uint64_t, grpc::Status> {
-    try {
-        auto space = std::filesystem::space(BLOBS_PATH);
-        Logger::info("Free storage: ", space.free);
-        return (uint64_t) space.free;
-    } catch (const std::filesystem::filesystem_error &fse) {
-        Logger::error("Error while getting free storage: ", fse.what());
-        return grpc::Status(grpc::CANCELLED, fse.what());
-    }
+double elapsed_us(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
 }
 
-auto receive_blob_from_frontend(
-        grpc::ServerReader<worker::SaveBlobRequest> *reader) -> Expected<std::string, grpc::Status> {
+/// Forwards a SaveBlob stream to the next worker of the replication chain. The next worker
+/// forwards it further, so finish() returns only after the tail of the chain has saved the blob.
+/// A stream that isn't finished gets cancelled, the rest of the chain drops the partial blob.
+class ChainForwarder {
+    std::string address_;
+    grpc::ClientContext context_;
+    worker::SaveBlobResponse response_;
+    std::unique_ptr<worker::WorkerService::Stub> stub_;
+    std::unique_ptr<grpc::ClientWriter<worker::SaveBlobRequest>> writer_;
+    bool finished_ = false;
+public:
+    explicit ChainForwarder(std::string address) : address_(std::move(address))
+    {
+        stub_ = ChannelPool::instance().stub<worker::WorkerService>(address_);
+        writer_ = stub_->SaveBlob(&context_, &response_);
+    }
+
+    ~ChainForwarder()
+    {
+        if (!finished_) {
+            context_.TryCancel();
+            writer_->Finish();
+        }
+    }
+
+    auto forward(const worker::SaveBlobRequest& request) -> Expected<std::monostate, grpc::Status>
+    {
+        if (!writer_->Write(request)) {
+            return grpc::Status(grpc::CANCELLED, "Failed to forward blob to worker " + address_ + " - broken stream");
+        }
+        return std::monostate{};
+    }
+
+    auto finish() -> Expected<std::monostate, grpc::Status>
+    {
+        finished_ = true;
+        writer_->WritesDone();
+        if (const auto status = writer_->Finish(); !status.ok()) {
+            Logger::error("Worker ", address_, " in the chain failed: ", status.error_message());
+            return grpc::Status(grpc::CANCELLED, "Worker " + address_ + ": " + status.error_message());
+        }
+        return std::monostate{};
+    }
+};
+
+struct ReceivedBlob {
+    std::string hash;
+    std::optional<std::string> upload_id; // set for pipelined uploads
+    uint64_t stored_size; // bytes on disk, less than the blob size if it got compressed
+    std::shared_ptr<ChainForwarder> next_in_chain; // set for chain replication, still to be finished
+};
+
+auto receive_blob_from_frontend(grpc::ServerReader<worker::SaveBlobRequest> *reader, BlobStorage &storage,
+                                SpaceLedger &space, Ewma &io_latency_us) -> Expected<ReceivedBlob, grpc::Status> {
     worker::SaveBlobRequest request;
 
     try {
         BlobHasher blob_hasher;
-        std::optional<BlobFile> blob_file;
+        std::unique_ptr<BlobStorage::Upload> upload; // dropped on every early return
+        std::unique_ptr<SpaceLedger::Reservation> reservation;
+        std::optional<worker::SaveBlobCommit> commit;
         std::string request_hash;
+        std::shared_ptr<ChainForwarder> next_in_chain;
 
         while (reader->Read(&request)) {
             if (request_hash.empty()) {
                 request_hash = request.blob_hash();
                 Logger::info("Start receiving, hash: ", request_hash);
-                blob_file = BlobFile::New(request_hash);
+                // Rejected before anything is written or forwarded, the disk doesn't fill up mid-stream.
+                reservation = space.reserve(request.has_blob_size() ? request.blob_size() : 0);
+                if (!reservation) {
+                    return grpc::Status(grpc::RESOURCE_EXHAUSTED, "Not enough free space for the blob.");
+                }
+                upload = storage.start_upload(request_hash,
+                                              request.has_blob_size() ? std::optional(request.blob_size()) : std::nullopt);
+                if (request.chain_size() > 0) {
+                    Logger::info("Forwarding to ", request.chain(0), ", workers left in the chain: ", request.chain_size());
+                    next_in_chain = std::make_shared<ChainForwarder>(request.chain(0));
+                    request.mutable_chain()->DeleteSubrange(0, 1);
+                }
+            }
+            if (!reservation->consume(request.chunk_data().size())) {
+                Logger::error("Out of free space while receiving ", request_hash);
+                return grpc::Status(grpc::RESOURCE_EXHAUSTED, "Not enough free space for the blob.");
+            }
+            // The next worker gets the stream first, so it writes the chunk at the same time as we do.
+            if (next_in_chain) {
+                if (auto forwarded = next_in_chain->forward(request); !forwarded.has_value()) {
+                    return forwarded.error();
+                }
+            }
+            if (request.has_commit()) {
+                commit = request.commit();
+                break;
             }
 
             Logger::info("Received chunk size: ", ssize(request.chunk_data()));
-            *blob_file += request.chunk_data();
+            const auto write_start = std::chrono::steady_clock::now();
+            upload->append(request.chunk_data());
+            io_latency_us.add(elapsed_us(write_start));
             blob_hasher += request.chunk_data();
         }
 
         auto blob_hash = blob_hasher.finalize();
+        if (not upload) {
+            return grpc::Status(grpc::INVALID_ARGUMENT, "Empty SaveBlob stream.");
+        }
+
+        // Pipelined upload: the data was saved under the upload id, the frontend tells us the real hash.
+        if (commit) {
+            if (commit->abort()) {
+                Logger::warn("Upload ", request_hash, " aborted by frontend.");
+                return grpc::Status(grpc::ABORTED, "Upload aborted by frontend.");
+            }
+            if (commit->blob_hash() != blob_hash) {
+                Logger::error("Blob hash mismatch: ", commit->blob_hash(), " != ", blob_hash);
+                return grpc::Status(grpc::INVALID_ARGUMENT, "Blob hash mismatch.");
+            }
+            upload->commit(blob_hash);
+            Logger::info("Finish receiving upload ", request_hash, ", hash: ", blob_hash);
+            return ReceivedBlob{blob_hash, request_hash, upload->stored_size(), next_in_chain};
+        }
+
         if (request_hash != blob_hash) {
             Logger::error("Blob hash mismatch: ", request_hash, " != ", blob_hash);
-            blob_file->remove();
             return grpc::Status(grpc::INVALID_ARGUMENT, "Blob hash mismatch.");
         }
 
+        upload->commit(request_hash);
         Logger::info("Finish receiving, hash: ", request_hash);
-        return request_hash;
+        return ReceivedBlob{request_hash, std::nullopt, upload->stored_size(), next_in_chain};
     }
     catch (const BlobFile::FileSystemException &fse) {
         Logger::error("Error while receiving blob: ", fse.what());
@@ -57,39 +155,145 @@ auto receive_blob_from_frontend(
     }
 }
 
+/// Reads the chunks of [offset, end) on its own thread, up to READ_AHEAD_CHUNKS ahead of the caller,
+/// so reading the disk overlaps with writing the previous chunks to the network.
+/// Chunks of big blobs leave the page cache once read, so streaming them doesn't evict the hot small blobs.
+/// Example usage:
+///   ChunkPrefetcher prefetcher(reader, offset, end);
+///   prefetcher.next(*response.mutable_chunk_data()); // the chunk at offset
+class ChunkPrefetcher {
+public:
+    constexpr static size_t READ_AHEAD_CHUNKS = 4;
+private:
+    constexpr static uint64_t DROP_CACHED_MIN_BLOB_SIZE = 64 * 1024 * 1024;
+
+    BlobStorage::Reader &reader_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::string> ready_;
+    std::vector<std::string> free_; // buffers to read into, reused
+    std::exception_ptr error_;
+    bool stopped_ = false;
+    std::jthread thread_; // last, so it's joined before the rest is destroyed
+
+    void run(const uint64_t offset, const uint64_t end, const bool drop_cached) {
+        try {
+            for (uint64_t position = offset; position < end; position += BlobStoreConfig::MAX_CHUNK_SIZE) {
+                const auto chunk_size = std::min(BlobStoreConfig::MAX_CHUNK_SIZE, end - position);
+                std::string chunk;
+                {
+                    std::unique_lock lock(mutex_);
+                    changed_.wait(lock, [&] { return stopped_ || !free_.empty(); });
+                    if (stopped_) {
+                        return;
+                    }
+                    chunk = std::move(free_.back());
+                    free_.pop_back();
+                }
+                reader_.read(position, chunk_size, chunk);
+                if (drop_cached) {
+                    reader_.drop_cached(position, chunk_size);
+                }
+                std::lock_guard lock(mutex_);
+                ready_.push_back(std::move(chunk));
+                changed_.notify_all();
+            }
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            error_ = std::current_exception();
+            changed_.notify_all();
+        }
+    }
+
+public:
+    ChunkPrefetcher(BlobStorage::Reader &reader, const uint64_t offset, const uint64_t end)
+        : reader_(reader), free_(READ_AHEAD_CHUNKS) {
+        reader_.advise_sequential(offset, end - offset);
+        const bool drop_cached = reader_.size() >= DROP_CACHED_MIN_BLOB_SIZE;
+        thread_ = std::jthread([this, offset, end, drop_cached] { run(offset, end, drop_cached); });
+    }
+
+    ~ChunkPrefetcher() {
+        std::lock_guard lock(mutex_);
+        stopped_ = true;
+        changed_.notify_all();
+    }
+
+    /// Swaps the next chunk into out, out's old buffer is reused for reading further.
+    /// Throws what reading the chunk threw.
+    void next(std::string &out) {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [&] { return !ready_.empty() || error_; });
+        if (ready_.empty()) {
+            std::rethrow_exception(error_);
+        }
+        std::swap(out, ready_.front());
+        free_.push_back(std::move(ready_.front()));
+        ready_.pop_front();
+        changed_.notify_all();
+    }
+};
+
 auto send_blob_to_frontend(const worker::GetBlobRequest *request,
-                           grpc::ServerWriter<worker::GetBlobResponse> *writer) -> Expected<std::monostate, grpc::Status> {
+                           grpc::ServerWriter<worker::GetBlobResponse> *writer,
+                           BlobStorage &storage, Ewma &io_latency_us) -> Expected<std::monostate, grpc::Status> {
     try {
-        BlobFile blob_file = BlobFile::Load(request->blob_hash());
-        for (auto chunk: blob_file) {
-            worker::GetBlobResponse response;
-            response.set_chunk_data(chunk);
+        const auto reader = storage.open(request->blob_hash());
+        const uint64_t blob_size = reader->size();
+        const uint64_t offset = request->offset();
+        if (offset > blob_size) {
+            Logger::error("Requested offset ", offset, " is past the end of the blob (", blob_size, ")");
+            return grpc::Status(grpc::OUT_OF_RANGE, "Offset is past the end of the blob.");
+        }
+        const uint64_t length = request->has_length() ? request->length() : blob_size - offset;
+        const uint64_t end = offset + std::min(length, blob_size - offset);
+
+        // The chunks are read straight into buffers swapped into the response, there is no copy on the way.
+        // A blob of more than one chunk is read ahead while the previous chunks are being sent.
+        worker::GetBlobResponse response;
+        std::optional<ChunkPrefetcher> prefetcher;
+        if (end - offset > BlobStoreConfig::MAX_CHUNK_SIZE) {
+            prefetcher.emplace(*reader, offset, end);
+        }
+        for (uint64_t position = offset; position < end; position += BlobStoreConfig::MAX_CHUNK_SIZE) {
+            const auto chunk_size = std::min(BlobStoreConfig::MAX_CHUNK_SIZE, end - position);
+            const auto read_start = std::chrono::steady_clock::now();
+            if (prefetcher) {
+                prefetcher->next(*response.mutable_chunk_data());
+            } else {
+                reader->read(position, chunk_size, *response.mutable_chunk_data());
+            }
+            io_latency_us.add(elapsed_us(read_start));
+            // The stored checksum saves hashing the chunk again, it's computed only when there is none.
+            const auto stored_checksum = reader->checksum(position, chunk_size);
+            response.set_chunk_checksum(stored_checksum ? *stored_checksum : BlobHasher::checksum(response.chunk_data()));
             if (not writer->Write(response)) {
                 Logger::error("Write stream was closed.");
                 return grpc::Status(grpc::INVALID_ARGUMENT, "Write stream was closed.");
             }
-            Logger::info("Sent chunk size: ", ssize(chunk));
+            Logger::info("Sent chunk size: ", chunk_size);
         }
         Logger::info("Blob sent successfully.");
         return std::monostate{};
     }
+    catch (const BlobStorage::CorruptBlobException &cbe) {
+        Logger::error("Corrupt blob: ", cbe.what());
+        return grpc::Status(grpc::DATA_LOSS, cbe.what());
+    }
     catch (const BlobFile::FileSystemException &fse) {
         Logger::error("Error while sending blob: ", fse.what());
         return grpc::Status(grpc::CANCELLED, fse.what());
     }
 }
 
-auto delete_file(const std::string &hash) -> Expected<std::monostate, grpc::Status> {
-    auto filepath = BLOBS_PATH + hash;
-
+auto delete_blob(const std::string &hash, BlobStorage &storage) -> Expected<std::monostate, grpc::Status> {
     try {
-        if (not std::filesystem::exists(filepath)) {
-            Logger::error("Error while deleting blob: file not found ", filepath);
-            return grpc::Status(grpc::CANCELLED, "Error while deleting blob: file not found " + filepath);
+        if (not storage.remove(hash)) {
+            Logger::error("Error while deleting blob: blob not found ", hash);
+            return grpc::Status(grpc::CANCELLED, "Error while deleting blob: blob not found " + hash);
         }
 
-        std::filesystem::remove(filepath);
-        Logger::info("Blob deleted successfully: ", filepath);
+        Logger::info("Blob deleted successfully: ", hash);
         return std::monostate{};
     }
     catch (const BlobFile::FileSystemException &fse) {
@@ -97,9 +301,140 @@ auto delete_file(const std::string &hash) -> Expected<std::monostate, grpc::Stat
         return grpc::Status(grpc::CANCELLED, fse.what());
     }
 }
+/// Copies the blob from the worker at address (verifying its chunks and hash) into storage.
+/// Returns the bytes it takes in storage.
+auto copy_blob_from_replica(const std::string &address, const std::string &blob_hash,
+                            BlobStorage &storage, SpaceLedger &space) -> Expected<uint64_t, grpc::Status> {
+    try {
+        const auto stub = ChannelPool::instance().stub<worker::WorkerService>(address);
+        grpc::ClientContext context;
+        worker::GetBlobRequest request;
+        request.set_blob_hash(blob_hash);
+        const auto reader = stub->GetBlob(&context, request);
+
+        const auto upload = storage.start_upload(blob_hash, std::nullopt); // dropped on every early return
+        const auto reservation = space.reserve(0);
+        BlobHasher blob_hasher;
+        worker::GetBlobResponse response;
+        while (reader->Read(&response)) {
+            if (response.has_chunk_checksum() &&
+                BlobHasher::checksum(response.chunk_data()) != response.chunk_checksum()) {
+                context.TryCancel();
+                reader->Finish();
+                return grpc::Status(grpc::DATA_LOSS, "Corrupt chunk from " + address);
+            }
+            if (!reservation->consume(response.chunk_data().size())) {
+                context.TryCancel();
+                reader->Finish();
+                return grpc::Status(grpc::RESOURCE_EXHAUSTED, "Not enough free space for the blob.");
+            }
+            upload->append(response.chunk_data());
+            blob_hasher += response.chunk_data();
+        }
+        if (const auto status = reader->Finish(); !status.ok()) {
+            return status;
+        }
+        if (blob_hasher.finalize() != blob_hash) {
+            return grpc::Status(grpc::DATA_LOSS, "Blob from " + address + " doesn't match its hash");
+        }
+        upload->commit(blob_hash);
+        return upload->stored_size();
+    }
+    catch (const BlobFile::FileSystemException &fse) {
+        return grpc::Status(grpc::CANCELLED, fse.what());
+    }
+}
+
+/// Chunks a call may hold in memory: a received one and the one being forwarded down the chain,
+/// or the read-ahead chunks and the one being sent.
+constexpr uint64_t SAVE_BLOB_BUFFER_BYTES = 2 * BlobStoreConfig::MAX_CHUNK_SIZE;
+constexpr uint64_t GET_BLOB_BUFFER_BYTES = (ChunkPrefetcher::READ_AHEAD_CHUNKS + 1) * BlobStoreConfig::MAX_CHUNK_SIZE;
+
+/// Counts a request in flight for its lifetime.
+class InFlightRequest {
+    std::atomic<int> &counter_;
+public:
+    explicit InFlightRequest(std::atomic<int> &counter) : counter_(counter) { ++counter_; }
+    ~InFlightRequest() { --counter_; }
+};
 ///---- END HELPERS ----///
 
 ///---- BEGIN WORKER SERVICE ----///
+auto WorkerServiceImpl::notify_blob_saved(const std::string &blob_hash,
+                                          const std::optional<std::string> &upload_id,
+                                          const uint64_t stored_size) -> Expected<std::monostate, grpc::Status> {
+    master::NotifyBlobSavedRequest notify_request;
+    notify_request.set_worker_address(worker_address);
+    notify_request.set_blob_hash(blob_hash);
+    if (upload_id) {
+        notify_request.set_upload_id(*upload_id);
+    }
+    notify_request.set_stored_size_bytes(stored_size);
+    Logger::info("Notifying master: ", notify_request.DebugString());
+
+    grpc::ClientContext client_context;
+    master::NotifyBlobSavedResponse notify_response;
+
+    auto status = master_stub_->NotifyBlobSaved(&client_context, notify_request,
+                                                &notify_response);
+
+    if (status.ok()) {
+        Logger::info("Notified master successfully.");
+        return std::monostate{};
+    } else {
+        Logger::error("Error while notifying master: ", status.error_message());
+        return grpc::Status(grpc::CANCELLED, status.error_message());
+    }
+}
+
+master::HeartbeatRequest WorkerServiceImpl::heartbeat() {
+    master::HeartbeatRequest heartbeat_request;
+    heartbeat_request.set_worker_address(worker_address);
+    heartbeat_request.set_free_space_bytes(space_->available());
+    heartbeat_request.set_reserved_space_bytes(space_->reserved());
+    heartbeat_request.set_streams_in_flight(requests_in_flight_);
+    heartbeat_request.set_io_latency_us(static_cast<uint64_t>(io_latency_us_.value()));
+    return heartbeat_request;
+}
+
+void WorkerServiceImpl::repair_corrupt_blob(const std::string &blob_hash) {
+    master::ReportCorruptBlobRequest report_request;
+    report_request.set_worker_address(worker_address);
+    report_request.set_blob_hash(blob_hash);
+    master::ReportCorruptBlobResponse report_response;
+    grpc::ClientContext client_context;
+    if (const auto status = master_stub_->ReportCorruptBlob(&client_context, report_request, &report_response);
+        !status.ok()) {
+        Logger::error("Error while reporting corrupt blob ", blob_hash, ": ", status.error_message());
+        return;
+    }
+
+    storage_->remove(blob_hash);
+    for (const auto &source : report_response.repair_sources()) {
+        Logger::info("Repairing blob ", blob_hash, " from ", source);
+        const auto repaired = copy_blob_from_replica(source, blob_hash, *storage_, *space_)
+                .and_then([&](const uint64_t stored_size) {
+                    return notify_blob_saved(blob_hash, std::nullopt, stored_size);
+                });
+        if (repaired.has_value()) {
+            Logger::info("Blob ", blob_hash, " repaired");
+            return;
+        }
+        Logger::warn("Couldn't repair blob ", blob_hash, " from ", source, ": ", repaired.error().error_message());
+    }
+    Logger::error("Blob ", blob_hash, " couldn't be repaired, the copy is dropped");
+    if (report_response.repair_sources_size() == 0) {
+        return; // the master has dropped the copy already
+    }
+    // Otherwise the master keeps the copy and the space locked for its repair.
+    report_request.set_repair_failed(true);
+    grpc::ClientContext drop_context;
+    if (const auto status = master_stub_->ReportCorruptBlob(&drop_context, report_request, &report_response);
+        !status.ok()) {
+        Logger::error("Error while dropping the copy of blob ", blob_hash, ": ", status.error_message());
+    }
+}
+
 grpc::Status WorkerServiceImpl::Healthcheck(grpc::ServerContext *context,
                                             const worker::HealthcheckRequest *request,
                                             worker::HealthcheckResponse *response) {
@@ -113,42 +448,31 @@ grpc::Status WorkerServiceImpl::GetFreeStorage(grpc::ServerContext *context,
                                                worker::GetFreeStorageResponse *response) {
     Logger::info("GetFreeStorage request received");
 
-    return get_free_storage()
-            .and_then([&](uint64_t storage) -> Expected<std::monostate, grpc::Status> {
-                response->set_storage(storage);
-                return std::monostate{};
-            })
-            .output<grpc::Status>(
-                    [](auto _) { return grpc::Status::OK; },
-                    std::identity()
-            );
+    response->set_storage(space_->available());
+    return grpc::Status::OK;
 }
 
 grpc::Status WorkerServiceImpl::SaveBlob(grpc::ServerContext *context,
                                          grpc::ServerReader<worker::SaveBlobRequest> *reader,
                                          worker::SaveBlobResponse *response) {
     Logger::info("SaveBlob request received");
+    const auto permit = admission_->admit(AdmissionControl::Kind::Upload, SAVE_BLOB_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return permit.error();
+    }
+    const InFlightRequest in_flight(requests_in_flight_);
 
-    return receive_blob_from_frontend(reader)
-            .and_then([&](const std::string &hash) -> Expected<std::monostate, grpc::Status> {
-                master::NotifyBlobSavedRequest notify_request;
-                notify_request.set_worker_address(worker_address);
-                notify_request.set_blob_hash(hash);
-                Logger::info("Notifying master: ", notify_request.DebugString());
-
-                grpc::ClientContext client_context;
-                master::NotifyBlobSavedResponse notify_response;
-
-                auto status = master_stub_->NotifyBlobSaved(&client_context, notify_request,
-                                                            &notify_response);
-
-                if (status.ok()) {
-                    Logger::info("Notified master successfully.");
-                    return std::monostate{};
-                } else {
-                    Logger::error("Error while notifying master: ", status.error_message());
-                    return grpc::Status(grpc::CANCELLED, status.error_message());
+    return receive_blob_from_frontend(reader, *storage_, *space_, io_latency_us_)
+            .and_then([&](const ReceivedBlob &blob) -> Expected<ReceivedBlob, grpc::Status> {
+                return notify_blob_saved(blob.hash, blob.upload_id, blob.stored_size)
+                        .and_then([&](auto _) -> Expected<ReceivedBlob, grpc::Status> { return blob; });
+            })
+            .and_then([&](const ReceivedBlob &blob) -> Expected<std::monostate, grpc::Status> {
+                // Chain replication: acknowledge only when the rest of the chain has the blob too.
+                if (blob.next_in_chain) {
+                    return blob.next_in_chain->finish();
                 }
+                return std::monostate{};
             })
             .output<grpc::Status>(
                     [](auto _) { return grpc::Status::OK; },
@@ -160,8 +484,13 @@ grpc::Status WorkerServiceImpl::GetBlob(grpc::ServerContext *context,
                                         const worker::GetBlobRequest *request,
                                         grpc::ServerWriter<worker::GetBlobResponse> *writer) {
     Logger::info("GetBlob request received");
+    const auto permit = admission_->admit(AdmissionControl::Kind::Download, GET_BLOB_BUFFER_BYTES, *context);
+    if (!permit.has_value()) {
+        return permit.error();
+    }
+    const InFlightRequest in_flight(requests_in_flight_);
 
-    return send_blob_to_frontend(request, writer)
+    return send_blob_to_frontend(request, writer, *storage_, io_latency_us_)
             .output<grpc::Status>(
                     [](auto _) { return grpc::Status::OK; },
                     std::identity()
@@ -173,7 +502,7 @@ grpc::Status WorkerServiceImpl::DeleteBlob(grpc::ServerContext *context,
                                            worker::DeleteBlobResponse *response) {
     Logger::info("DeleteBlob request received");
 
-    return delete_file(request->blob_hash())
+    return delete_blob(request->blob_hash(), *storage_)
             .output<grpc::Status>(
                     [](auto _) { return grpc::Status::OK; },
                     std::identity()
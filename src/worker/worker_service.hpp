@@ -1,6 +1,7 @@
 #ifndef BLOB_STORE_WORKER_SERVICE_HPP
 #define BLOB_STORE_WORKER_SERVICE_HPP
 
+#include <atomic>
 #include <filesystem>
 #include <fstream>
 #include <utility>
@@ -8,27 +9,52 @@
 #include "services/worker_service.grpc.pb.h"
 #include "services/master_service.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
+#include "admission_control.hpp"
+#include "blob_storage.hpp"
 #include "blob_hasher.hpp"
+#include "ewma.hpp"
 #include "expected.hpp"
 #include "logging.hpp"
+#include "space_ledger.hpp"
 
 // We assume that blobs are stored in the blobs/ directory which is created in the same
 // directory as the executable.
 const std::string BLOBS_PATH = "blobs/";
 
-
-auto get_free_storage() -> Expected<uint64_t, grpc::Status>;
-
 class WorkerServiceImpl final : public worker::WorkerService::Service {
     std::unique_ptr<master::MasterService::Stub> master_stub_;
     std::string worker_address;
+    std::shared_ptr<BlobStorage> storage_;
+    std::shared_ptr<SpaceLedger> space_;
+    std::shared_ptr<AdmissionControl> admission_;
+    std::atomic<int> requests_in_flight_ {0}; // saving or sending a blob
+    Ewma io_latency_us_ {0.1}; // of a chunk read from or written to storage
+
+    /// Tells the master the blob is saved here.
+    auto notify_blob_saved(const std::string &blob_hash, const std::optional<std::string> &upload_id,
+                           uint64_t stored_size) -> Expected<std::monostate, grpc::Status>;
 public:
-    explicit WorkerServiceImpl(const std::shared_ptr<grpc::Channel>& channel, std::string worker_id)
-            : master_stub_(master::MasterService::NewStub(channel)), worker_address(std::move(worker_id))
+    explicit WorkerServiceImpl(const std::shared_ptr<grpc::Channel>& channel, std::string worker_id,
+                               std::shared_ptr<BlobStorage> storage = std::make_shared<FileBlobStorage>(),
+                               std::shared_ptr<SpaceLedger> space = std::make_shared<SpaceLedger>(BLOBS_PATH),
+                               std::shared_ptr<AdmissionControl> admission =
+                                   std::make_shared<AdmissionControl>(AdmissionControl::Options()))
+            : master_stub_(master::MasterService::NewStub(channel)), worker_address(std::move(worker_id)),
+              storage_(std::move(storage)), space_(std::move(space)), admission_(std::move(admission))
     {
             Logger::info("Current path is: ", std::filesystem::current_path());
     }
 
+    /// True while blobs are being saved or sent, background work should wait.
+    [[nodiscard]] bool busy() const { return requests_in_flight_ > 0; }
+
+    /// The worker's free space and load, for the masters.
+    [[nodiscard]] master::HeartbeatRequest heartbeat();
+
+    /// Reports the corrupt copy of the blob to the master, drops it and copies the blob
+    /// again from a replica with an intact copy.
+    void repair_corrupt_blob(const std::string &blob_hash);
+
     grpc::Status Healthcheck(
             grpc::ServerContext *context,
             const worker::HealthcheckRequest *request,
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <future>
+#include <thread>
+#include "admission_control.hpp"
+
+class AdmissionControlTest : public ::testing::Test {
+protected:
+    using Kind = AdmissionControl::Kind;
+    grpc::ServerContext context_;
+
+    static AdmissionControl::Options options(const std::chrono::milliseconds max_queue_wait) {
+        AdmissionControl::Options options;
+        options.max_uploads = 2;
+        options.max_downloads = 1;
+        options.memory_bytes = 100;
+        options.max_queued = 1;
+        options.max_queue_wait = max_queue_wait;
+        return options;
+    }
+};
+
+TEST_F(AdmissionControlTest, LimitsConcurrentCallsPerKind) {
+    AdmissionControl admission(options(std::chrono::milliseconds(0)));
+    const auto first = admission.try_admit(Kind::Upload, 10, context_);
+    const auto second = admission.try_admit(Kind::Upload, 10, context_);
+    ASSERT_TRUE(first.has_value());
+    ASSERT_TRUE(second.has_value());
+
+    const auto third = admission.admit(Kind::Upload, 10, context_);
+    ASSERT_FALSE(third.has_value());
+    EXPECT_EQ(third.error().error_code(), grpc::RESOURCE_EXHAUSTED);
+    // Downloads have their own slots.
+    EXPECT_TRUE(admission.try_admit(Kind::Download, 10, context_).has_value());
+}
+
+TEST_F(AdmissionControlTest, LimitsBufferedMemory) {
+    AdmissionControl admission(options(std::chrono::milliseconds(0)));
+    auto upload = admission.try_admit(Kind::Upload, 80, context_);
+    ASSERT_TRUE(upload.has_value());
+    EXPECT_FALSE(admission.try_admit(Kind::Download, 30, context_).has_value());
+
+    upload.value().reset();
+    // A call bigger than the whole quota gets in when nothing else runs.
+    EXPECT_TRUE(admission.try_admit(Kind::Download, 500, context_).has_value());
+}
+
+TEST_F(AdmissionControlTest, QueuedCallGetsTheFreedSlot) {
+    AdmissionControl admission(options(std::chrono::seconds(10)));
+    auto download = admission.try_admit(Kind::Download, 10, context_);
+    ASSERT_TRUE(download.has_value());
+
+    auto queued = std::async(std::launch::async, [&] {
+        grpc::ServerContext context;
+        return admission.admit(Kind::Download, 10, context).has_value();
+    });
+    EXPECT_EQ(queued.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+    // The queue is full.
+    EXPECT_FALSE(admission.admit(Kind::Download, 10, context_).has_value());
+
+    download.value().reset();
+    EXPECT_TRUE(queued.get());
+}
+
+TEST_F(AdmissionControlTest, QueuedCallIsRejectedAfterTheWait) {
+    AdmissionControl admission(options(std::chrono::milliseconds(30)));
+    const auto download = admission.try_admit(Kind::Download, 10, context_);
+    ASSERT_TRUE(download.has_value());
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto queued = admission.admit(Kind::Download, 10, context_);
+    EXPECT_FALSE(queued.has_value());
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(30));
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "blob_cache.hpp"
+
+TEST(BlobCacheTest, GetReturnsPutBlob) {
+    BlobCache cache(100, 10);
+    cache.put("hash", "skibidi", cache.generation());
+
+    const auto blob = cache.get("hash");
+    ASSERT_NE(blob, nullptr);
+    EXPECT_EQ(*blob, "skibidi");
+    EXPECT_EQ(cache.get("other"), nullptr);
+}
+
+TEST(BlobCacheTest, TooBigBlobIsNotCached) {
+    BlobCache cache(100, 10);
+    cache.put("hash", std::string(11, 'a'), cache.generation());
+
+    EXPECT_EQ(cache.get("hash"), nullptr);
+    EXPECT_EQ(cache.size_bytes(), 0);
+}
+
+TEST(BlobCacheTest, StaysWithinCapacity) {
+    BlobCache cache(100, 10);
+    for (int i = 0; i < 100; ++i) {
+        cache.put(std::to_string(i), std::string(10, 'a'), cache.generation());
+        EXPECT_LE(cache.size_bytes(), 100);
+    }
+}
+
+TEST(BlobCacheTest, ScanDoesNotEvictHotBlobs) {
+    BlobCache cache(100, 10);
+    cache.put("hot", std::string(10, 'h'), cache.generation());
+    cache.get("hot");
+
+    // One-time blobs pass through probation only.
+    for (int i = 0; i < 100; ++i) {
+        cache.put("scan" + std::to_string(i), std::string(10, 's'), cache.generation());
+    }
+
+    EXPECT_NE(cache.get("hot"), nullptr);
+}
+
+TEST(BlobCacheTest, EraseInvalidatesBlob) {
+    BlobCache cache(100, 10);
+    cache.put("hash", "skibidi", cache.generation());
+    cache.erase("hash");
+
+    EXPECT_EQ(cache.get("hash"), nullptr);
+    EXPECT_EQ(cache.size_bytes(), 0);
+}
+
+TEST(BlobCacheTest, PutAfterEraseIsIgnored) {
+    BlobCache cache(100, 10);
+    // The blob was being fetched while someone deleted it.
+    const auto generation = cache.generation();
+    cache.erase("hash");
+    cache.put("hash", "skibidi", generation);
+
+    EXPECT_EQ(cache.get("hash"), nullptr);
+}
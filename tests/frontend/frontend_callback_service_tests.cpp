@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <grpcpp/grpcpp.h>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include "services/frontend_service.grpc.pb.h"
+#include "services/master_service.grpc.pb.h"
+#include "services/worker_service.grpc.pb.h"
+#include "blob_hasher.hpp"
+#include "frontend_callback_service.hpp"
+
+/// A master which places every blob on the same workers.
+class FakeMaster final : public master::MasterService::Service {
+public:
+    std::vector<std::string> workers;
+
+    grpc::Status GetWorkersToSaveBlob(grpc::ServerContext*, const master::GetWorkersToSaveBlobRequest*,
+                                      master::GetWorkersToSaveBlobResponse* response) override {
+        response->mutable_addresses()->Assign(workers.begin(), workers.end());
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetWorkerWithBlob(grpc::ServerContext*, const master::GetWorkerWithBlobRequest*,
+                                   master::GetWorkerWithBlobResponse* response) override {
+        response->set_addresses(workers.front());
+        response->mutable_replicas()->Assign(workers.begin(), workers.end());
+        return grpc::Status::OK;
+    }
+};
+
+/// A worker which keeps what it was sent. Its GetBlob sends the first chunk and then stalls until cancelled.
+class FakeWorker final : public worker::WorkerService::Service {
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::string received_;
+    std::optional<worker::SaveBlobCommit> commit_;
+    bool save_done_ = false;
+    bool get_cancelled_ = false;
+
+    void update(const std::function<void()>& change) {
+        std::lock_guard lock(mutex_);
+        change();
+        changed_.notify_all();
+    }
+
+public:
+    grpc::Status SaveBlob(grpc::ServerContext*, grpc::ServerReader<worker::SaveBlobRequest>* reader,
+                          worker::SaveBlobResponse*) override {
+        worker::SaveBlobRequest request;
+        while (reader->Read(&request)) {
+            update([&] {
+                received_ += request.chunk_data();
+                if (request.has_commit()) {
+                    commit_ = request.commit();
+                }
+            });
+        }
+        update([&] { save_done_ = true; });
+        return grpc::Status::OK;
+    }
+
+    grpc::Status GetBlob(grpc::ServerContext* context, const worker::GetBlobRequest*,
+                         grpc::ServerWriter<worker::GetBlobResponse>* writer) override {
+        worker::GetBlobResponse response;
+        response.set_chunk_data("first chunk");
+        response.set_chunk_checksum(BlobHasher::checksum(response.chunk_data()));
+        writer->Write(response);
+        while (!context->IsCancelled()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        update([&] { get_cancelled_ = true; });
+        return grpc::Status::CANCELLED;
+    }
+
+    /// Waits (at most 5 s) until the upload stream has brought the given bytes.
+    bool wait_received(const std::string& bytes) {
+        std::unique_lock lock(mutex_);
+        return changed_.wait_for(lock, std::chrono::seconds(5), [&] { return received_ == bytes; });
+    }
+
+    /// Waits (at most 5 s) until the upload stream ended, returns its last commit message.
+    std::optional<worker::SaveBlobCommit> wait_save_done() {
+        std::unique_lock lock(mutex_);
+        EXPECT_TRUE(changed_.wait_for(lock, std::chrono::seconds(5), [this] { return save_done_; }));
+        return commit_;
+    }
+
+    /// Waits (at most 5 s) until the download stream was cancelled.
+    bool wait_get_cancelled() {
+        std::unique_lock lock(mutex_);
+        return changed_.wait_for(lock, std::chrono::seconds(5), [this] { return get_cancelled_; });
+    }
+};
+
+class FrontendCallbackServiceTest : public ::testing::Test {
+protected:
+    FakeMaster master_;
+    std::vector<std::unique_ptr<FakeWorker>> workers_;
+    std::vector<std::unique_ptr<grpc::Server>> servers_;
+    std::unique_ptr<FrontendCallbackServiceImpl> frontend_;
+    std::unique_ptr<frontend::Frontend::Stub> stub_;
+
+    std::string start(grpc::Service& service) {
+        int port = 0;
+        grpc::ServerBuilder builder;
+        builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(), &port);
+        builder.RegisterService(&service);
+        servers_.push_back(builder.BuildAndStart());
+        return "localhost:" + std::to_string(port);
+    }
+
+    void SetUp() override {
+        for (int i = 0; i < 2; i++) {
+            master_.workers.push_back(start(*workers_.emplace_back(std::make_unique<FakeWorker>())));
+        }
+        setenv(ENV_MASTERS_COUNT, "1", 1);
+        setenv(ENV_CONTAINER_PORT, "0", 1);
+        auto config = FrontendConfig::LoadFromEnv();
+        config.master_services = {start(master_)};
+        frontend_ = std::make_unique<FrontendCallbackServiceImpl>(config);
+        stub_ = frontend::Frontend::NewStub(grpc::CreateChannel(start(*frontend_), grpc::InsecureChannelCredentials()));
+    }
+
+    void TearDown() override {
+        // The frontend first, its calls to the workers end before the workers go.
+        for (auto it = servers_.rbegin(); it != servers_.rend(); ++it) {
+            (*it)->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+        }
+    }
+};
+
+TEST_F(FrontendCallbackServiceTest, UploadIsSavedOnEveryWorker) {
+    const std::string blob = "The quick brown fox jumps over the lazy dog.";
+    grpc::ClientContext context;
+    frontend::UploadBlobResponse response;
+    const auto writer = stub_->UploadBlob(&context, &response);
+
+    frontend::UploadBlobRequest request;
+    request.mutable_info()->set_size_bytes(blob.size());
+    ASSERT_TRUE(writer->Write(request));
+    for (size_t position = 0; position < blob.size(); position += 10) {
+        request.set_chunk_data(blob.substr(position, 10));
+        ASSERT_TRUE(writer->Write(request));
+    }
+    writer->WritesDone();
+    const auto status = writer->Finish();
+
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    const auto hash = (BlobHasher() += blob).finalize();
+    EXPECT_EQ(response.blob_hash(), hash);
+    for (const auto& worker : workers_) {
+        EXPECT_TRUE(worker->wait_received(blob));
+        const auto commit = worker->wait_save_done();
+        ASSERT_TRUE(commit.has_value());
+        EXPECT_FALSE(commit->abort());
+        EXPECT_EQ(commit->blob_hash(), hash);
+    }
+}
+
+TEST_F(FrontendCallbackServiceTest, CancelledUploadIsNotCommitted) {
+    grpc::ClientContext context;
+    frontend::UploadBlobResponse response;
+    const auto writer = stub_->UploadBlob(&context, &response);
+
+    frontend::UploadBlobRequest request;
+    request.mutable_info()->set_size_bytes(100);
+    ASSERT_TRUE(writer->Write(request));
+    request.set_chunk_data("only part of the blob");
+    ASSERT_TRUE(writer->Write(request));
+    for (const auto& worker : workers_) {
+        ASSERT_TRUE(worker->wait_received(request.chunk_data()));
+    }
+    context.TryCancel();
+
+    EXPECT_EQ(writer->Finish().error_code(), grpc::CANCELLED);
+    for (const auto& worker : workers_) {
+        const auto commit = worker->wait_save_done();
+        EXPECT_TRUE(!commit.has_value() || commit->abort());
+    }
+}
+
+TEST_F(FrontendCallbackServiceTest, CancelledDownloadCancelsTheWorkerStream) {
+    grpc::ClientContext context;
+    frontend::GetBlobRequest request;
+    request.set_blob_hash("hash");
+    const auto reader = stub_->GetBlob(&context, request);
+
+    frontend::GetBlobResponse response;
+    ASSERT_TRUE(reader->Read(&response));
+    EXPECT_EQ(response.chunk_data(), "first chunk");
+    context.TryCancel();
+
+    EXPECT_EQ(reader->Finish().error_code(), grpc::CANCELLED);
+    EXPECT_TRUE(workers_[0]->wait_get_cancelled());
+}
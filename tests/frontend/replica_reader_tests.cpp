@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <grpcpp/grpcpp.h>
+#include <thread>
+#include "services/worker_service.grpc.pb.h"
+#include "blob_hasher.hpp"
+#include "replica_reader.hpp"
+
+/// A worker serving one blob in small chunks, which may misbehave on the way.
+class FakeWorker final : public worker::WorkerService::Service {
+public:
+    constexpr static size_t CHUNK_SIZE = 10;
+
+    std::string blob;
+    std::chrono::milliseconds first_chunk_delay {0};
+    std::optional<size_t> fail_after_chunks;
+    std::optional<size_t> stall_after_chunks;
+    std::optional<size_t> corrupt_chunk;
+    std::atomic<int> calls {0};
+
+    grpc::Status GetBlob(grpc::ServerContext* context, const worker::GetBlobRequest* request,
+                         grpc::ServerWriter<worker::GetBlobResponse>* writer) override {
+        calls++;
+        const auto until = std::chrono::steady_clock::now() + first_chunk_delay;
+        while (std::chrono::steady_clock::now() < until) {
+            if (context->IsCancelled()) {
+                return grpc::Status::CANCELLED;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        const auto end = request->has_length() ? std::min(blob.size(), request->offset() + request->length())
+                                               : blob.size();
+        size_t sent = 0;
+        for (auto position = request->offset(); position < end; position += CHUNK_SIZE, sent++) {
+            if (sent == fail_after_chunks) {
+                return grpc::Status(grpc::UNAVAILABLE, "Worker broke mid-stream.");
+            }
+            while (sent == stall_after_chunks && !context->IsCancelled()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            worker::GetBlobResponse response;
+            response.set_chunk_data(blob.substr(position, std::min(CHUNK_SIZE, end - position)));
+            response.set_chunk_checksum(BlobHasher::checksum(response.chunk_data()) + (sent == corrupt_chunk ? 1 : 0));
+            if (!writer->Write(response)) {
+                return grpc::Status::CANCELLED;
+            }
+        }
+        return grpc::Status::OK;
+    }
+};
+
+class ReplicaReaderTest : public ::testing::Test {
+protected:
+    const std::string blob_ = "The quick brown fox jumps over the lazy dog, again and again and again.";
+    std::vector<std::unique_ptr<FakeWorker>> workers_;
+    std::vector<std::unique_ptr<grpc::Server>> servers_;
+    std::vector<std::string> addresses_;
+
+    FakeWorker& add_worker() {
+        auto& worker = *workers_.emplace_back(std::make_unique<FakeWorker>());
+        worker.blob = blob_;
+        int port = 0;
+        grpc::ServerBuilder builder;
+        builder.AddListeningPort("localhost:0", grpc::InsecureServerCredentials(), &port);
+        builder.RegisterService(&worker);
+        servers_.push_back(builder.BuildAndStart());
+        addresses_.push_back("localhost:" + std::to_string(port));
+        return worker;
+    }
+
+    void TearDown() override {
+        for (const auto& server : servers_) {
+            server->Shutdown();
+        }
+    }
+
+    /// The read bytes go to data_.
+    auto read(const uint64_t offset = 0, const std::optional<uint64_t> length = std::nullopt)
+        -> Expected<std::monostate, std::string> {
+        ReplicaReader reader("hash", addresses_, offset, length, std::chrono::milliseconds(50),
+                             std::chrono::milliseconds(500));
+        return reader.read([&](std::string& chunk, std::optional<uint64_t>) -> Expected<std::monostate, std::string> {
+            data_ += chunk;
+            return std::monostate{};
+        });
+    }
+
+    std::string data_;
+};
+
+TEST_F(ReplicaReaderTest, SlowReplicaIsHedged) {
+    add_worker().first_chunk_delay = std::chrono::seconds(10);
+    add_worker();
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto result = read();
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_EQ(data_, blob_);
+    EXPECT_EQ(workers_[1]->calls, 1);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST_F(ReplicaReaderTest, ReadResumesOnNextReplicaAfterMidStreamFailure) {
+    add_worker().fail_after_chunks = 3;
+    add_worker();
+
+    const auto result = read();
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_EQ(data_, blob_);
+}
+
+TEST_F(ReplicaReaderTest, ReadResumesOnNextReplicaAfterMidStreamStall) {
+    add_worker().stall_after_chunks = 3;
+    add_worker();
+
+    const auto result = read();
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_EQ(data_, blob_);
+    EXPECT_EQ(workers_[1]->calls, 1);
+}
+
+TEST_F(ReplicaReaderTest, CorruptChunkIsReadFromNextReplica) {
+    add_worker().corrupt_chunk = 2;
+    add_worker();
+
+    const auto result = read(5, 40);
+    ASSERT_TRUE(result.has_value()) << result.error();
+    EXPECT_EQ(data_, blob_.substr(5, 40));
+}
+
+TEST_F(ReplicaReaderTest, FailsWhenAllReplicasFail) {
+    add_worker().fail_after_chunks = 1;
+    add_worker().corrupt_chunk = 0;
+
+    EXPECT_FALSE(read().has_value());
+}
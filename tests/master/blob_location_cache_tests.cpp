@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "blob_location_cache.hpp"
+
+using Workers = std::vector<std::string>;
+
+static BlobLocationCache::Options options(const size_t max_entries) {
+    BlobLocationCache::Options options;
+    options.max_entries = max_entries;
+    return options;
+}
+
+TEST(BlobLocationCacheTest, GetReturnsPutWorkers) {
+    BlobLocationCache cache(options(10));
+    cache.put("hash", {"w1", "w2"}, cache.generation());
+
+    EXPECT_EQ(cache.get("hash"), (Workers{"w1", "w2"}));
+    EXPECT_EQ(cache.get("other"), std::nullopt);
+}
+
+TEST(BlobLocationCacheTest, IncompleteLocationsAreNotCached) {
+    auto options = ::options(10);
+    options.min_workers = 2;
+    BlobLocationCache cache(options);
+    // Not stored yet, or only one of the copies saved so far.
+    cache.put("missing", {}, cache.generation());
+    cache.put("partial", {"w1"}, cache.generation());
+
+    EXPECT_EQ(cache.get("missing"), std::nullopt);
+    EXPECT_EQ(cache.get("partial"), std::nullopt);
+}
+
+TEST(BlobLocationCacheTest, LeastRecentlyUsedIsEvicted) {
+    BlobLocationCache cache(options(2));
+    cache.put("a", {"w1"}, cache.generation());
+    cache.put("b", {"w1"}, cache.generation());
+    cache.get("a");
+    cache.put("c", {"w1"}, cache.generation());
+
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_NE(cache.get("a"), std::nullopt);
+    EXPECT_EQ(cache.get("b"), std::nullopt);
+}
+
+TEST(BlobLocationCacheTest, EntriesExpire) {
+    auto short_ttl = options(10);
+    short_ttl.ttl = std::chrono::milliseconds(30);
+    BlobLocationCache cache(short_ttl);
+    cache.put("hash", {"w1"}, cache.generation());
+
+    EXPECT_NE(cache.get("hash"), std::nullopt);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    EXPECT_EQ(cache.get("hash"), std::nullopt);
+}
+
+TEST(BlobLocationCacheTest, InvalidationWinsOverStaleLookup) {
+    BlobLocationCache cache(options(10));
+    const auto generation = cache.generation();
+    cache.erase("hash"); // e.g. deleted while the lookup was querying the database
+    cache.put("hash", {"w1"}, generation);
+
+    EXPECT_EQ(cache.get("hash"), std::nullopt);
+}
+
+TEST(BlobLocationCacheTest, EraseWorkerDropsItsBlobs) {
+    BlobLocationCache cache(options(10));
+    cache.put("a", {"w1", "w2"}, cache.generation());
+    cache.put("b", {"w2", "w3"}, cache.generation());
+    cache.erase_worker("w1");
+
+    EXPECT_EQ(cache.get("a"), std::nullopt);
+    EXPECT_EQ(cache.get("b"), (Workers{"w2", "w3"}));
+}
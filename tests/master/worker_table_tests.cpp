@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <map>
+#include "worker_table.hpp"
+
+TEST(WorkerTableTest, PicksWorkersWithTheMostFreeSpace) {
+    WorkerTable table;
+    table.replace_all({
+        WorkerStateDTO("a", 100, 90, 0),
+        WorkerStateDTO("b", 100, 0, 0),
+        WorkerStateDTO("c", 50, 0, 0),
+        WorkerStateDTO("d", 80, 0, 0),
+    });
+
+    EXPECT_EQ(table.pick(20, 2, 0), (std::vector<std::string>{"b", "d"}));
+    EXPECT_EQ(table.pick(20, 5, 0), (std::vector<std::string>{"b", "d", "c"}));
+    EXPECT_TRUE(table.pick(200, 1, 0).empty());
+}
+
+TEST(WorkerTableTest, PutReplacesTheWorkerState) {
+    WorkerTable table;
+    table.put(WorkerStateDTO("a", 100, 0, 0));
+    table.put(WorkerStateDTO("a", 100, 95, 0));
+
+    EXPECT_EQ(table.size(), 1);
+    EXPECT_EQ(table.get("a")->locked_space_mb, 95);
+    EXPECT_TRUE(table.pick(10, 1, 0).empty());
+    EXPECT_EQ(table.get("b"), std::nullopt);
+}
+
+TEST(WorkerTableTest, ReplaceAllDropsMissingWorkers) {
+    WorkerTable table;
+    table.put(WorkerStateDTO("a", 100, 0, 0));
+    table.replace_all({WorkerStateDTO("b", 100, 0, 0)});
+
+    EXPECT_EQ(table.get("a"), std::nullopt);
+    EXPECT_EQ(table.pick(10, 3, 0), (std::vector<std::string>{"b"}));
+}
+
+TEST(WorkerTableTest, WorkersWithoutRecentHeartbeatAreStale) {
+    WorkerTable table;
+    table.replace_all({
+        WorkerStateDTO("a", 100, 0, 1000),
+        WorkerStateDTO("b", 200, 0, 900),
+    });
+
+    EXPECT_EQ(table.pick(10, 2, 950), (std::vector<std::string>{"a"}));
+    EXPECT_TRUE(table.is_stale("b", 950));
+    EXPECT_FALSE(table.is_stale("unknown", 950));
+
+    EXPECT_TRUE(table.record_heartbeat("b", 50, 1000));
+    EXPECT_FALSE(table.record_heartbeat("unknown", 50, 1000));
+    EXPECT_FALSE(table.is_stale("b", 950));
+    EXPECT_EQ(table.pick(10, 2, 950), (std::vector<std::string>{"a", "b"}));
+}
+
+TEST(WorkerTableTest, MostLoadedReplicaIsNeverReadFirst) {
+    WorkerTable table;
+    table.record_load("a", 1, 500);
+    table.record_load("b", 2, 500);
+    table.record_load("c", 50, 5000);
+
+    for (int i = 0; i < 100; i++) {
+        const auto order = table.order_for_read({"a", "b", "c"});
+        ASSERT_EQ(order.size(), 3);
+        EXPECT_NE(order[0], "c");
+        EXPECT_EQ(order[2], "c");
+        table.record_load(order[0], order[0] == "a" ? 1 : 2, 500); // as if a heartbeat came in between
+    }
+}
+
+TEST(WorkerTableTest, RoutedReadsSpreadOverEqualReplicas) {
+    WorkerTable table;
+    table.record_load("a", 0, 100);
+    table.record_load("b", 0, 100);
+
+    std::map<std::string, int> first;
+    for (int i = 0; i < 10; i++) {
+        first[table.order_for_read({"a", "b"})[0]]++;
+    }
+    EXPECT_EQ(first["a"], 5);
+    EXPECT_EQ(first["b"], 5);
+    EXPECT_EQ(table.load("a")->reads_routed, 5);
+    // A heartbeat counts the routed reads in its streams.
+    table.record_load("a", 5, 100);
+    EXPECT_EQ(table.load("a")->reads_routed, 0);
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "blob_hasher.hpp"
+#include "blob_storage_test.hpp"
+#include "blob_scrubber.hpp"
+#include "checksummed_blob_storage.hpp"
+
+class BlobScrubberTest : public BlobStorageTest {
+protected:
+    std::shared_ptr<PackedBlobStorage> packed_;
+    std::shared_ptr<IndexedBlobStorage> storage_;
+
+    BlobScrubberTest() : BlobStorageTest("blob_scrubber_tests") {}
+
+    void SetUp() override {
+        BlobStorageTest::SetUp();
+        packed_ = make_packed(directory_ / "segments");
+        storage_ = std::make_shared<IndexedBlobStorage>(std::make_shared<ChecksummedBlobStorage>(packed_),
+                                                        directory_ / "index.log", BlobFile::Durability::None);
+    }
+
+    void TearDown() override {
+        storage_.reset();
+        packed_.reset();
+        BlobStorageTest::TearDown();
+    }
+
+    std::string put_blob(const size_t size, const char seed) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<char>(seed + i * 13);
+        }
+        const auto hash = (BlobHasher() += data).finalize();
+        put(*storage_, hash, data);
+        return hash;
+    }
+
+    /// Replaces the stored bytes, keeping the checksums.
+    void corrupt(const std::string& hash) {
+        auto data = get(*packed_, hash);
+        data[data.size() / 2] ^= 1;
+        packed_->remove(hash);
+        put(*packed_, hash, data);
+    }
+
+    static BlobScrubber::Options fast() {
+        BlobScrubber::Options options;
+        options.bytes_per_second = 1ULL << 40;
+        return options;
+    }
+};
+
+TEST_F(BlobScrubberTest, IntactBlobsPass) {
+    put_blob(1000, 'a');
+    put_blob(3 * BlobStoreConfig::MAX_CHUNK_SIZE + 7, 'b');
+    BlobScrubber scrubber(storage_, fast(), {}, [](const std::string&) { FAIL() << "nothing is corrupt"; });
+    EXPECT_EQ(scrubber.scrub_all(), 0);
+}
+
+TEST_F(BlobScrubberTest, CorruptBlobsAreReported) {
+    const auto small = put_blob(1000, 'a');
+    const auto big = put_blob(3 * BlobStoreConfig::MAX_CHUNK_SIZE + 7, 'b');
+    put_blob(2000, 'c');
+    corrupt(small);
+    corrupt(big);
+
+    std::vector<std::string> reported;
+    BlobScrubber scrubber(storage_, fast(), {}, [&](const std::string& hash) { reported.push_back(hash); });
+    EXPECT_EQ(scrubber.scrub_all(), 2);
+    std::ranges::sort(reported);
+    auto expected = std::vector{small, big};
+    std::ranges::sort(expected);
+    EXPECT_EQ(reported, expected);
+}
+
+TEST_F(BlobScrubberTest, ReadsWithinTheBudget) {
+    const auto hash = put_blob(4 * BlobStoreConfig::MAX_CHUNK_SIZE, 'a');
+    auto options = fast();
+    options.bytes_per_second = 20 * BlobStoreConfig::MAX_CHUNK_SIZE;
+    BlobScrubber scrubber(storage_, options, {}, {});
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(scrubber.scrub(hash, 4 * BlobStoreConfig::MAX_CHUNK_SIZE));
+    // The first chunk is read right away, each of the next three waits 50 ms.
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(140));
+}
+
+TEST_F(BlobScrubberTest, WaitsWhileBusy) {
+    const auto hash = put_blob(1000, 'a');
+    auto options = fast();
+    options.busy_backoff = std::chrono::milliseconds(10);
+    int busy_checks = 0;
+    BlobScrubber scrubber(storage_, options, [&] { return ++busy_checks <= 5; }, {});
+
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(scrubber.scrub(hash, 1000));
+    EXPECT_EQ(busy_checks, 6);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <limits>
+#include "packed_blob_storage.hpp"
+
+/// Base of the storage layer tests: a directory of the test's own, emptied before and after every test,
+/// and helpers to store and read whole blobs through any layer.
+class BlobStorageTest : public ::testing::Test {
+protected:
+    const fs::path directory_;
+
+    explicit BlobStorageTest(const std::string& name) : directory_(fs::temp_directory_path() / name) {}
+
+    void SetUp() override {
+        fs::remove_all(directory_);
+    }
+
+    void TearDown() override {
+        fs::remove_all(directory_);
+    }
+
+    static std::shared_ptr<PackedBlobStorage> make_packed(
+            const fs::path& directory, const uint64_t max_blob_bytes = 16 << 20,
+            const uint64_t segment_bytes = PackedBlobStorage::Options{}.segment_bytes) {
+        PackedBlobStorage::Options options;
+        options.max_blob_bytes = max_blob_bytes;
+        options.segment_bytes = segment_bytes;
+        return std::make_shared<PackedBlobStorage>(directory, BlobFile::Durability::None,
+                                                   std::make_unique<FileBlobStorage>(), options);
+    }
+
+    /// Uploads the blob in appends of at most piece_size bytes and commits it.
+    /// Returns the bytes it takes in the storage.
+    static uint64_t put(BlobStorage& storage, const std::string& hash, const std::string& data,
+                        const size_t piece_size = std::numeric_limits<size_t>::max()) {
+        const auto upload = storage.start_upload(hash, data.size());
+        for (size_t i = 0; i < data.size(); i += piece_size) {
+            upload->append(std::string_view(data).substr(i, piece_size));
+        }
+        upload->commit(hash);
+        return upload->stored_size();
+    }
+
+    static std::string read(BlobStorage& storage, const std::string& hash, const uint64_t offset,
+                            const uint64_t length) {
+        std::string out;
+        storage.open(hash)->read(offset, length, out);
+        return out;
+    }
+
+    static std::string get(BlobStorage& storage, const std::string& hash) {
+        const auto reader = storage.open(hash);
+        std::string data;
+        reader->read(0, reader->size(), data);
+        return data;
+    }
+};
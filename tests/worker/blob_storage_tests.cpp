@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "blob_storage.hpp"
+
+class FileBlobStorageTest : public ::testing::Test {
+protected:
+    FileBlobStorage storage_;
+
+    void SetUp() override {
+        BlobFile::RemoveStaged();
+    }
+
+    void TearDown() override {
+        for (const auto* hash : {"staged_hash", "same_hash"}) {
+            storage_.remove(hash);
+        }
+        BlobFile::RemoveStaged();
+    }
+
+    std::string read_all(const std::string& hash) {
+        const auto reader = storage_.open(hash);
+        std::string data;
+        reader->read(0, reader->size(), data);
+        return data;
+    }
+};
+
+TEST_F(FileBlobStorageTest, UploadIsNotReadableUntilCommitted) {
+    const auto upload = storage_.start_upload("staged_hash", std::nullopt);
+    upload->append("partial");
+    EXPECT_THROW(storage_.open("staged_hash"), BlobFile::FileSystemException);
+
+    upload->append(" data");
+    upload->commit("staged_hash");
+    EXPECT_EQ(read_all("staged_hash"), "partial data");
+}
+
+TEST_F(FileBlobStorageTest, ConcurrentUploadsOfTheSameBlobDontClobber) {
+    const auto first = storage_.start_upload("same_hash", std::nullopt);
+    const auto second = storage_.start_upload("same_hash", std::nullopt);
+    first->append("same ");
+    second->append("same ");
+    second->append("data");
+    second->commit("same_hash");
+    first->append("data");
+    first->commit("same_hash");
+
+    EXPECT_EQ(read_all("same_hash"), "same data");
+}
+
+TEST_F(FileBlobStorageTest, RemoveStagedReturnsIncompleteUploads) {
+    {
+        const auto committed = storage_.start_upload("staged_hash", std::nullopt);
+        committed->append("data");
+        committed->commit("staged_hash");
+    }
+    auto first = BlobFile::Stage("upload-1");
+    auto second = BlobFile::Stage("upload-2");
+
+    auto aborted = BlobFile::RemoveStaged();
+    std::ranges::sort(aborted);
+    EXPECT_EQ(aborted, (std::vector<std::string>{"upload-1", "upload-2"}));
+    EXPECT_FALSE(fs::exists(first.path()));
+    EXPECT_TRUE(BlobFile::RemoveStaged().empty());
+    EXPECT_EQ(read_all("staged_hash"), "data");
+}
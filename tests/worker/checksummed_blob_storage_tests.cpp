@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "blob_hasher.hpp"
+#include "blob_storage_test.hpp"
+#include "checksummed_blob_storage.hpp"
+
+class ChecksummedBlobStorageTest : public BlobStorageTest {
+protected:
+    constexpr static auto CHUNK_SIZE = ChecksummedBlobStorage::CHUNK_SIZE;
+    std::shared_ptr<PackedBlobStorage> inner_;
+    std::unique_ptr<ChecksummedBlobStorage> storage_;
+
+    ChecksummedBlobStorageTest() : BlobStorageTest("checksummed_blob_storage_tests") {}
+
+    void SetUp() override {
+        BlobStorageTest::SetUp();
+        inner_ = make_packed(directory_);
+        storage_ = std::make_unique<ChecksummedBlobStorage>(inner_);
+    }
+
+    void TearDown() override {
+        storage_.reset();
+        inner_.reset();
+        BlobStorageTest::TearDown();
+    }
+
+    static std::string make_blob(const size_t size) {
+        std::string blob(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            blob[i] = static_cast<char>(i * 31 + i / 4096);
+        }
+        return blob;
+    }
+};
+
+TEST_F(ChecksummedBlobStorageTest, ServesStoredChunkChecksums) {
+    const auto data = make_blob(2 * CHUNK_SIZE + 1000);
+    put(*storage_, "hash", data, 300'000);
+
+    const auto reader = storage_->open("hash");
+    EXPECT_EQ(reader->checksum(0, CHUNK_SIZE), BlobHasher::checksum(std::string_view(data).substr(0, CHUNK_SIZE)));
+    EXPECT_EQ(reader->checksum(2 * CHUNK_SIZE, 1000), BlobHasher::checksum(std::string_view(data).substr(2 * CHUNK_SIZE)));
+    EXPECT_EQ(reader->checksum(10, CHUNK_SIZE), std::nullopt);
+    EXPECT_EQ(reader->checksum(0, 100), std::nullopt);
+}
+
+TEST_F(ChecksummedBlobStorageTest, RangeReads) {
+    const auto data = make_blob(3 * CHUNK_SIZE + 5);
+    put(*storage_, "hash", data, 300'000);
+
+    EXPECT_EQ(read(*storage_, "hash", 0, data.size()), data);
+    EXPECT_EQ(read(*storage_, "hash", CHUNK_SIZE, CHUNK_SIZE), data.substr(CHUNK_SIZE, CHUNK_SIZE));
+    EXPECT_EQ(read(*storage_, "hash", 123, CHUNK_SIZE), data.substr(123, CHUNK_SIZE));
+    EXPECT_EQ(read(*storage_, "hash", data.size() - 3, 3), data.substr(data.size() - 3));
+}
+
+TEST_F(ChecksummedBlobStorageTest, CorruptChunkIsDetected) {
+    auto data = make_blob(2 * CHUNK_SIZE);
+    put(*storage_, "hash", data, 300'000);
+    data[CHUNK_SIZE + 17] ^= 1;
+    inner_->remove("hash"); // the checksums stay
+    put(*inner_, "hash", data);
+
+    EXPECT_EQ(read(*storage_, "hash", 0, CHUNK_SIZE), data.substr(0, CHUNK_SIZE));
+    EXPECT_THROW(read(*storage_, "hash", CHUNK_SIZE, CHUNK_SIZE), BlobStorage::CorruptBlobException);
+    EXPECT_THROW(read(*storage_, "hash", CHUNK_SIZE + 100, 10), BlobStorage::CorruptBlobException);
+}
+
+TEST_F(ChecksummedBlobStorageTest, SingleChunkBlobIsVerifiedWithItsHash) {
+    auto data = make_blob(5000);
+    const auto hash = (BlobHasher() += data).finalize();
+    put(*storage_, hash, data, 300'000);
+    EXPECT_EQ(read(*storage_, hash, 10, 100), data.substr(10, 100));
+    EXPECT_THROW(storage_->open(hash + ChecksummedBlobStorage::SIDECAR_SUFFIX), BlobFile::FileSystemException);
+
+    data[0] ^= 1;
+    inner_->remove(hash);
+    put(*inner_, hash, data);
+    EXPECT_THROW(read(*storage_, hash, 10, 100), BlobStorage::CorruptBlobException);
+}
+
+TEST_F(ChecksummedBlobStorageTest, RemoveDropsTheChecksums) {
+    put(*storage_, "hash", make_blob(2 * CHUNK_SIZE), 300'000);
+    EXPECT_TRUE(storage_->remove("hash"));
+    EXPECT_THROW(inner_->open(std::string("hash") + ChecksummedBlobStorage::SIDECAR_SUFFIX),
+                 BlobFile::FileSystemException);
+}
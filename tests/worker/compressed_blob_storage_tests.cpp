@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "blob_storage_test.hpp"
+#include "compressed_blob_storage.hpp"
+
+class CompressedBlobStorageTest : public BlobStorageTest {
+protected:
+    std::shared_ptr<PackedBlobStorage> inner_;
+    std::unique_ptr<CompressedBlobStorage> storage_;
+
+    CompressedBlobStorageTest() : BlobStorageTest("compressed_blob_storage_tests") {}
+
+    void SetUp() override {
+        BlobStorageTest::SetUp();
+        inner_ = make_packed(directory_);
+        storage_ = std::make_unique<CompressedBlobStorage>(inner_, CompressedBlobStorage::Options{});
+    }
+
+    void TearDown() override {
+        storage_.reset();
+        inner_.reset();
+        BlobStorageTest::TearDown();
+    }
+
+    static std::string text(const size_t size) {
+        std::string data;
+        for (int line = 0; data.size() < size; line++) {
+            data += "{\"line\": " + std::to_string(line) + ", \"level\": \"info\", \"message\": \"request served\"}\n";
+        }
+        data.resize(size);
+        return data;
+    }
+
+    static std::string random_bytes(const size_t size) {
+        std::mt19937_64 generator(42);
+        std::string data(size, '\0');
+        for (auto& byte : data) {
+            byte = static_cast<char>(generator());
+        }
+        return data;
+    }
+};
+
+TEST_F(CompressedBlobStorageTest, CompressibleBlobRoundTrip) {
+    const auto data = text(3 * CompressedBlobStorage::CHUNK_SIZE + 12345);
+    const auto stored_size = put(*storage_, "hash", data, 100'000);
+
+    EXPECT_LT(stored_size, data.size() / 3);
+    EXPECT_EQ(inner_->open("hash")->size(), stored_size);
+    const auto reader = storage_->open("hash");
+    EXPECT_EQ(reader->size(), data.size());
+    std::string out;
+    reader->read(0, data.size(), out);
+    EXPECT_EQ(out, data);
+}
+
+TEST_F(CompressedBlobStorageTest, RangeReadsAcrossChunks) {
+    const auto data = text(3 * CompressedBlobStorage::CHUNK_SIZE);
+    put(*storage_, "hash", data, 100'000);
+
+    const auto chunk = CompressedBlobStorage::CHUNK_SIZE;
+    EXPECT_EQ(read(*storage_, "hash", 10, 100), data.substr(10, 100));
+    EXPECT_EQ(read(*storage_, "hash", chunk - 50, 100), data.substr(chunk - 50, 100));
+    EXPECT_EQ(read(*storage_, "hash", chunk, 2 * chunk), data.substr(chunk, 2 * chunk));
+    EXPECT_EQ(read(*storage_, "hash", data.size() - 1, 1), data.substr(data.size() - 1));
+    EXPECT_THROW(read(*storage_, "hash", data.size() - 1, 2), BlobFile::FileSystemException);
+}
+
+TEST_F(CompressedBlobStorageTest, IncompressibleChunksStoredRaw) {
+    const auto data = random_bytes(2 * CompressedBlobStorage::CHUNK_SIZE + 777) + text(CompressedBlobStorage::CHUNK_SIZE);
+    const auto stored_size = put(*storage_, "hash", data, 100'000);
+
+    // The random part is stored raw, only the text shrinks.
+    EXPECT_GT(stored_size, 2 * CompressedBlobStorage::CHUNK_SIZE);
+    EXPECT_LT(stored_size, data.size());
+    EXPECT_EQ(read(*storage_, "hash", 0, data.size()), data);
+    EXPECT_EQ(read(*storage_, "hash", 1000, 5000), data.substr(1000, 5000));
+}
+
+TEST_F(CompressedBlobStorageTest, SmallBlobsStoredRaw) {
+    put(*storage_, "small", "skibidi");
+
+    std::string out;
+    inner_->open("small")->read(0, 7, out);
+    EXPECT_EQ(out, "skibidi");
+    EXPECT_EQ(inner_->open("small")->size(), 7 + sizeof(CompressedBlobStorage::Trailer));
+    EXPECT_EQ(storage_->open("small")->size(), 7);
+    EXPECT_EQ(read(*storage_, "small", 0, 7), "skibidi");
+    EXPECT_THROW(read(*storage_, "small", 0, 8), BlobFile::FileSystemException);
+}
+
+TEST_F(CompressedBlobStorageTest, SmallBlobEndingLikeCompressedOneIsReadAsItIs) {
+    // "payload" encoded as one raw chunk, uploaded by a client as the blob itself.
+    const CompressedBlobStorage::ChunkEntry entry {7, 0};
+    const CompressedBlobStorage::Trailer trailer {CompressedBlobStorage::TRAILER_MAGIC, 7, 7,
+                                                  CompressedBlobStorage::CHUNK_SIZE, 1};
+    const auto data = std::string("payload") + std::string(reinterpret_cast<const char*>(&entry), sizeof(entry)) +
+                      std::string(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+    put(*storage_, "crafted", data, 100'000);
+
+    const auto reader = storage_->open("crafted");
+    EXPECT_EQ(reader->size(), data.size());
+    EXPECT_EQ(read(*storage_, "crafted", 0, data.size()), data);
+}
+
+TEST_F(CompressedBlobStorageTest, ReadsBlobsStoredWithoutCompression) {
+    const auto data = text(2 * CompressedBlobStorage::CHUNK_SIZE);
+    const auto upload = inner_->start_upload("raw", data.size());
+    upload->append(data);
+    upload->commit("raw");
+
+    const auto reader = storage_->open("raw");
+    EXPECT_EQ(reader->size(), data.size());
+    EXPECT_EQ(read(*storage_, "raw", 100, 200), data.substr(100, 200));
+}
+
+TEST_F(CompressedBlobStorageTest, CompressedBlobsReadableWithCompressionOff) {
+    const auto data = text(2 * CompressedBlobStorage::CHUNK_SIZE);
+    put(*storage_, "compressed", data, 100'000);
+    CompressedBlobStorage::Options options;
+    options.compress = false;
+    storage_ = std::make_unique<CompressedBlobStorage>(inner_, options);
+    const auto stored_size = put(*storage_, "raw", data, 100'000);
+
+    EXPECT_EQ(stored_size, data.size() + sizeof(CompressedBlobStorage::Trailer));
+    EXPECT_EQ(read(*storage_, "compressed", 0, data.size()), data);
+    EXPECT_EQ(read(*storage_, "raw", 0, data.size()), data);
+    EXPECT_EQ(read(*storage_, "raw", 100, 200), data.substr(100, 200));
+}
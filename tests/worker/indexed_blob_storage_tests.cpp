@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "blob_storage_test.hpp"
+#include "indexed_blob_storage.hpp"
+
+class IndexedBlobStorageTest : public BlobStorageTest {
+protected:
+    IndexedBlobStorageTest() : BlobStorageTest("indexed_blob_storage_tests") {}
+
+    std::unique_ptr<IndexedBlobStorage> make_storage() {
+        return std::make_unique<IndexedBlobStorage>(make_packed(directory_ / "segments"), directory_ / "index.log",
+                                                    BlobFile::Durability::None);
+    }
+
+    static std::vector<std::string> hashes(const IndexedBlobStorage& storage) {
+        std::vector<std::string> hashes;
+        for (const auto& blob : storage.inventory()) {
+            hashes.push_back(blob.hash);
+        }
+        std::ranges::sort(hashes);
+        return hashes;
+    }
+};
+
+TEST_F(IndexedBlobStorageTest, InventoryHasCommittedBlobs) {
+    const auto storage = make_storage();
+    put(*storage, "hash1", "skibidi");
+    {
+        const auto upload = storage->start_upload("uncommitted", std::nullopt);
+        upload->append("partial");
+    }
+
+    const auto inventory = storage->inventory();
+    ASSERT_EQ(inventory.size(), 1);
+    EXPECT_EQ(inventory[0].hash, "hash1");
+    EXPECT_EQ(inventory[0].size_bytes, 7);
+}
+
+TEST_F(IndexedBlobStorageTest, InventorySurvivesRestart) {
+    {
+        const auto storage = make_storage();
+        put(*storage, "kept", "kept data");
+        put(*storage, "deleted", "deleted data");
+        storage->remove("deleted");
+    }
+
+    const auto storage = make_storage();
+    EXPECT_EQ(hashes(*storage), std::vector<std::string>{"kept"});
+}
+
+TEST_F(IndexedBlobStorageTest, PartialJournalEntryIsDropped) {
+    {
+        const auto storage = make_storage();
+        put(*storage, "kept", "kept data");
+    }
+    std::ofstream(directory_ / "index.log", std::ios::app) << "+ torn";
+
+    {
+        const auto storage = make_storage();
+        EXPECT_EQ(hashes(*storage), std::vector<std::string>{"kept"});
+        put(*storage, "added", "added data");
+    }
+
+    const auto storage = make_storage();
+    EXPECT_EQ(hashes(*storage), (std::vector<std::string>{"added", "kept"}));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "io_uring.hpp"
+
+class UringFileIoTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!IoUring::supported()) {
+            GTEST_SKIP() << "io_uring is not available";
+        }
+    }
+
+    static std::string make_blob(const size_t size) {
+        std::string blob(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            blob[i] = static_cast<char>('a' + i % 26);
+        }
+        return blob;
+    }
+};
+
+TEST_F(UringFileIoTest, WrittenChunksAreReadBack) {
+    const auto blob = make_blob(20 * 1000 + 7);
+    auto blob_file = BlobFile::New("uring_test.blob");
+    {
+        UringFileWriter writer(blob_file, BlobFile::Durability::Fdatasync, blob.size());
+        for (size_t position = 0; position < blob.size(); position += 1000) {
+            writer.append(std::string_view(blob).substr(position, 1000));
+        }
+        writer.commit();
+    }
+
+    UringFileReader reader(blob_file.path(), blob.size());
+    std::string read_blob;
+    std::string chunk;
+    for (size_t position = 0; position < blob.size(); position += 1000) {
+        reader.read(position, std::min<size_t>(1000, blob.size() - position), chunk);
+        read_blob += chunk;
+    }
+    EXPECT_EQ(read_blob, blob);
+
+    // Out of order reads drop the read ahead.
+    reader.read(3, 10, chunk);
+    EXPECT_EQ(chunk, blob.substr(3, 10));
+    reader.read(5000, 26, chunk);
+    EXPECT_EQ(chunk, blob.substr(5000, 26));
+
+    blob_file.remove();
+}
+
+TEST_F(UringFileIoTest, ReadPastTheEndThrows) {
+    auto blob_file = BlobFile::New("uring_test_short.blob");
+    blob_file += "short";
+
+    UringFileReader reader(blob_file.path(), 5);
+    std::string chunk;
+    EXPECT_THROW(reader.read(2, 10, chunk), BlobFile::FileSystemException);
+
+    blob_file.remove();
+}
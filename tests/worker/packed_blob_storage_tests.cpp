@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "blob_storage_test.hpp"
+
+class PackedBlobStorageTest : public BlobStorageTest {
+protected:
+    PackedBlobStorageTest() : BlobStorageTest("packed_blob_storage_tests") {}
+
+    std::shared_ptr<PackedBlobStorage> make_storage(const uint64_t segment_bytes = 1024 * 1024) {
+        return make_packed(directory_, 1024, segment_bytes);
+    }
+};
+
+TEST_F(PackedBlobStorageTest, GetReturnsPutBlob) {
+    const auto storage = make_storage();
+    put(*storage, "hash1", "skibidi");
+    put(*storage, "hash2", "sigma");
+
+    EXPECT_EQ(get(*storage, "hash1"), "skibidi");
+    EXPECT_EQ(get(*storage, "hash2"), "sigma");
+    EXPECT_THROW(storage->open("missing"), BlobFile::FileSystemException);
+}
+
+TEST_F(PackedBlobStorageTest, UncommittedUploadIsNotVisible) {
+    const auto storage = make_storage();
+    {
+        const auto upload = storage->start_upload("upload", std::nullopt);
+        upload->append("partial");
+    }
+
+    EXPECT_THROW(storage->open("upload"), BlobFile::FileSystemException);
+}
+
+TEST_F(PackedBlobStorageTest, IndexIsRebuiltAfterRestart) {
+    {
+        const auto storage = make_storage();
+        put(*storage, "kept", "kept data");
+        put(*storage, "deleted", "deleted data");
+        EXPECT_TRUE(storage->remove("deleted"));
+    }
+
+    const auto storage = make_storage();
+    EXPECT_EQ(get(*storage, "kept"), "kept data");
+    EXPECT_THROW(storage->open("deleted"), BlobFile::FileSystemException);
+    EXPECT_FALSE(storage->remove("deleted"));
+}
+
+TEST_F(PackedBlobStorageTest, CompactionReclaimsDeletedBlobs) {
+    const auto storage = make_storage(256);
+    for (int i = 0; i < 10; ++i) {
+        put(*storage, "hash" + std::to_string(i), std::string(100, 'a' + i));
+    }
+    const auto segments = storage->segment_count();
+    ASSERT_GT(segments, 2);
+    for (int i = 0; i < 8; ++i) {
+        storage->remove("hash" + std::to_string(i));
+    }
+
+    EXPECT_GT(storage->compact(), 0);
+    EXPECT_LT(storage->segment_count(), segments);
+    EXPECT_EQ(get(*storage, "hash8"), std::string(100, 'i'));
+    EXPECT_EQ(get(*storage, "hash9"), std::string(100, 'j'));
+}
+
+TEST_F(PackedBlobStorageTest, CompactionDoesntCopyTombstoneOfBlobStoredAgain) {
+    {
+        const auto storage = make_storage(256);
+        // Each of the segments takes about two records.
+        put(*storage, "old", std::string(200, 'o')); // keeps a segment older than the tombstone
+        put(*storage, "x", std::string(100, 'x'));
+        EXPECT_TRUE(storage->remove("x"));
+        put(*storage, "pad", std::string(100, 'p'));
+        // Stored again (as a repaired copy is) in a segment that isn't compacted.
+        put(*storage, "x", std::string(100, 'y'));
+        put(*storage, "kept", std::string(100, 'k'));
+        put(*storage, "tail", std::string(100, 't'));
+        EXPECT_TRUE(storage->remove("pad"));
+
+        EXPECT_EQ(storage->compact(), 1);
+        EXPECT_EQ(get(*storage, "x"), std::string(100, 'y'));
+    }
+
+    const auto storage = make_storage(256);
+    EXPECT_EQ(get(*storage, "x"), std::string(100, 'y'));
+    EXPECT_EQ(get(*storage, "kept"), std::string(100, 'k'));
+}
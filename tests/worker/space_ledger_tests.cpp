@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "space_ledger.hpp"
+
+class SpaceLedgerTest : public ::testing::Test {
+protected:
+    uint64_t free_ = 1000;
+    int probes_ = 0;
+
+    SpaceLedger make_ledger(const uint64_t margin, const std::chrono::milliseconds resync_interval = std::chrono::hours(1)) {
+        SpaceLedger::Options options;
+        options.safety_margin_bytes = margin;
+        options.resync_interval = resync_interval;
+        return SpaceLedger([this] { probes_++; return free_; }, options);
+    }
+};
+
+TEST_F(SpaceLedgerTest, ConcurrentReservationsDontShareSpace) {
+    auto ledger = make_ledger(100);
+    EXPECT_EQ(ledger.available(), 900);
+
+    const auto first = ledger.reserve(600);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(ledger.available(), 300);
+    EXPECT_EQ(ledger.reserve(400), nullptr);
+    const auto second = ledger.reserve(300);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(ledger.available(), 0);
+    EXPECT_EQ(probes_, 1);
+}
+
+TEST_F(SpaceLedgerTest, WrittenBytesStayUsedUntilResync) {
+    auto ledger = make_ledger(0);
+    {
+        const auto reservation = ledger.reserve(500);
+        EXPECT_TRUE(reservation->consume(200));
+        EXPECT_EQ(ledger.available(), 500);
+        EXPECT_EQ(ledger.reserved(), 300);
+    }
+    // The unwritten 300 bytes are back, the written 200 aren't.
+    EXPECT_EQ(ledger.available(), 800);
+    EXPECT_EQ(ledger.reserved(), 0);
+
+    free_ = 700;
+    ledger.resync();
+    EXPECT_EQ(ledger.available(), 700);
+}
+
+TEST_F(SpaceLedgerTest, ReservationGrowsWhileThereIsSpace) {
+    auto ledger = make_ledger(0);
+    const auto reservation = ledger.reserve(0);
+    EXPECT_TRUE(reservation->consume(600));
+    EXPECT_FALSE(reservation->consume(401));
+    EXPECT_EQ(ledger.available(), 400);
+    EXPECT_TRUE(reservation->consume(400));
+    EXPECT_EQ(ledger.available(), 0);
+}
+
+TEST_F(SpaceLedgerTest, ResyncsPeriodically) {
+    auto ledger = make_ledger(0, std::chrono::milliseconds(20));
+    EXPECT_EQ(ledger.available(), 1000);
+    free_ = 400;
+    EXPECT_EQ(ledger.available(), 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    EXPECT_EQ(ledger.available(), 400);
+    EXPECT_EQ(probes_, 2);
+}
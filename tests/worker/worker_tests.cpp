@@ -111,6 +111,82 @@ TEST_F(WorkerServiceTest, GetBlob) {
     EXPECT_EQ(response_blob, message);
 }
 
+TEST_F(WorkerServiceTest, GetBlobRange) {
+    std::filesystem::create_directory(BLOBS_PATH);
+    std::string message = "Skibidi sigma range";
+
+    auto hash = (BlobHasher() += message).finalize();
+    auto blob_file = BlobFile::New(hash);
+    blob_file += message;
+
+    worker::GetBlobRequest request;
+    worker::GetBlobResponse response;
+
+    grpc::ClientContext context;
+    request.set_blob_hash(hash);
+    request.set_offset(8);
+    request.set_length(5);
+
+    auto reader = stub_->GetBlob(&context, request);
+    std::string response_blob;
+    while (reader->Read(&response)) {
+        response_blob += response.chunk_data();
+    }
+
+    EXPECT_TRUE(reader->Finish().ok());
+    EXPECT_EQ(response_blob, message.substr(8, 5));
+}
+
+TEST_F(WorkerServiceTest, GetBlobMultipleChunks) {
+    std::filesystem::create_directory(BLOBS_PATH);
+    std::string message(BlobStoreConfig::MAX_CHUNK_SIZE * 2 + 123, 's');
+    message[BlobStoreConfig::MAX_CHUNK_SIZE] = 'x';
+
+    auto hash = (BlobHasher() += message).finalize();
+    auto blob_file = BlobFile::New(hash);
+    blob_file += message;
+
+    worker::GetBlobRequest request;
+    worker::GetBlobResponse response;
+
+    grpc::ClientContext context;
+    request.set_blob_hash(hash);
+    request.set_offset(10);
+
+    auto reader = stub_->GetBlob(&context, request);
+    std::string response_blob;
+    int chunks = 0;
+    while (reader->Read(&response)) {
+        response_blob += response.chunk_data();
+        chunks++;
+    }
+
+    EXPECT_TRUE(reader->Finish().ok());
+    EXPECT_EQ(chunks, 3);
+    EXPECT_EQ(response_blob, message.substr(10));
+}
+
+TEST_F(WorkerServiceTest, GetBlobOffsetOutOfRange) {
+    std::filesystem::create_directory(BLOBS_PATH);
+    std::string message = "Skibidi sigma short";
+
+    auto hash = (BlobHasher() += message).finalize();
+    auto blob_file = BlobFile::New(hash);
+    blob_file += message;
+
+    worker::GetBlobRequest request;
+    worker::GetBlobResponse response;
+
+    grpc::ClientContext context;
+    request.set_blob_hash(hash);
+    request.set_offset(message.size() + 1);
+
+    auto reader = stub_->GetBlob(&context, request);
+    while (reader->Read(&response)) {}
+
+    EXPECT_EQ(reader->Finish().error_code(), grpc::OUT_OF_RANGE);
+}
+
 TEST_F(WorkerServiceTest, DeleteBlob) {
     std::filesystem::create_directory(BLOBS_PATH);
     std::string message = "no more skibidi sigma";